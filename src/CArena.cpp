@@ -0,0 +1,64 @@
+#include "CArena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+CArena::CArena(size_t blockSize) :
+		_next(NULL),
+		_end(NULL),
+		_blockSize(blockSize),
+		_bytesAllocated(0)
+{
+
+}
+
+CArena::~CArena()
+{
+	release();
+}
+
+void CArena::reserve(size_t size)
+{
+	if (_next == NULL || static_cast<size_t>(_end - _next) < size)
+	{
+		addBlock(size);
+	}
+}
+
+void CArena::release()
+{
+	for (auto block : _blocks)
+	{
+		free(block);
+	}
+	_blocks.clear();
+	_next = NULL;
+	_end = NULL;
+	_bytesAllocated = 0;
+}
+
+size_t CArena::getNumBlocks() const
+{
+	return _blocks.size();
+}
+
+size_t CArena::getBytesAllocated() const
+{
+	return _bytesAllocated;
+}
+
+void CArena::addBlock(size_t minSize)
+{
+	// each block is at least as big as everything allocated so far, so the
+	// number of blocks only grows logarithmically with the arena size
+	size_t size = std::max(std::max(minSize, _blockSize), _bytesAllocated);
+	char* block = static_cast<char*>(malloc(size));
+	if (block == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	_blocks.push_back(block);
+	_next = block;
+	_end = block + size;
+	_bytesAllocated += size;
+}
@@ -0,0 +1,66 @@
+#ifndef SRC_CARENA_H_
+#define SRC_CARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator. Memory is handed out from large blocks and only given back
+// all at once by release() or the destructor. Destructors of objects created
+// in the arena are never run, so they must not own anything themselves.
+class CArena
+{
+public:
+	CArena(size_t blockSize = 1 << 20);
+	~CArena();
+
+	void* allocate(size_t size, size_t alignment);
+
+	template <typename T> T* allocateArray(size_t count);
+	template <typename T, typename... Args> T* create(Args&&... args);
+
+	// make sure the next size bytes come from a single block
+	void reserve(size_t size);
+	void release();
+
+	size_t getNumBlocks() const;
+	size_t getBytesAllocated() const;
+
+private:
+	CArena(const CArena&) = delete;
+	CArena& operator=(const CArena&) = delete;
+
+	void addBlock(size_t minSize);
+
+	std::vector<char*> _blocks;
+	char* _next;
+	char* _end;
+	size_t _blockSize;
+	size_t _bytesAllocated;
+};
+
+inline void* CArena::allocate(size_t size, size_t alignment)
+{
+	uintptr_t aligned = (reinterpret_cast<uintptr_t>(_next) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+	if (_next == NULL || aligned + size > reinterpret_cast<uintptr_t>(_end))
+	{
+		addBlock(size + alignment);
+		aligned = (reinterpret_cast<uintptr_t>(_next) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+	}
+	_next = reinterpret_cast<char*>(aligned + size);
+	return reinterpret_cast<void*>(aligned);
+}
+
+template <typename T> T* CArena::allocateArray(size_t count)
+{
+	return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+}
+
+template <typename T, typename... Args> T* CArena::create(Args&&... args)
+{
+	return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+#endif /* SRC_CARENA_H_ */
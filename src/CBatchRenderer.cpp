@@ -0,0 +1,200 @@
+#include "CBatchRenderer.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <strings.h>
+#include <utility>
+#include <vector>
+
+#include "CFlatTree.h"
+#include "CFpgaItem.h"
+#include "CFrameBuffer.h"
+#include "CImageWriter.h"
+#include "CThreadPool.h"
+#include "windirstat/CRect.h"
+#include "windirstat/CTreeMap.h"
+
+static const char* const METRIC_NAMES[NUM_UTILISATION_METRICS] = { "slice", "reg", "lut", "dsp", "ram" };
+
+CBatchRenderer::CBatchRenderer(CFpgaItem* root, uint32_t width, uint32_t height) :
+		_root(root),
+		_width(width),
+		_height(height),
+		_threadPool(NULL),
+		_lodArea(0),
+		_useFlatTree(false)
+{
+
+}
+
+CBatchRenderer::~CBatchRenderer()
+{
+
+}
+
+void CBatchRenderer::setThreadPool(CThreadPool* pool)
+{
+	_threadPool = pool;
+}
+
+void CBatchRenderer::setLodArea(uint32_t lodArea)
+{
+	_lodArea = lodArea;
+}
+
+void CBatchRenderer::setUseFlatTree(bool useFlatTree)
+{
+	_useFlatTree = useFlatTree;
+}
+
+CFpgaItem* CBatchRenderer::findItem(const char* name) const
+{
+	return findItem(_root, name);
+}
+
+CFpgaItem* CBatchRenderer::findItem(CFpgaItem* item, const char* name)
+{
+	if (item->getName().equals(name))
+	{
+		return item;
+	}
+	// every child, the sorted orders leave out those without the metric
+	for (uint32_t c = 0; c < item->getNumChildren(); c++)
+	{
+		CFpgaItem* found = findItem(item->getChildByIndex(c), name);
+		if (found)
+		{
+			return found;
+		}
+	}
+	return NULL;
+}
+
+bool CBatchRenderer::render(CFpgaItem* item, EUtilisationMetric metric, const char* filename)
+{
+	return render(item, metric, filename, _threadPool);
+}
+
+bool CBatchRenderer::render(CFpgaItem* item, EUtilisationMetric metric, const char* filename, CThreadPool* pool)
+{
+	// All our own, so any number can run at once
+	CFrameBuffer frameBuffer(_width, _height);
+	CTreeMap treeMap;
+	treeMap.SetThreadPool(pool);
+
+	CTreeMap::Options options = CTreeMap::GetDefaultOptions();
+	options.lodArea = _lodArea;
+	const CRect rc(0, 0, _width, _height);
+	if (_useFlatTree)
+	{
+		// only read here, so the gallery's images share it
+		CFlatTree* flatTree = getFlatTree(metric);
+		treeMap.DrawTreemap(&frameBuffer, rc, CFlatTree::View(flatTree), flatTree->findNode(item), &options);
+	}
+	else
+	{
+		item->drawTreeMap(treeMap, &frameBuffer, rc, metric, &options);
+	}
+
+	return CImageWriter::write(filename, frameBuffer);
+}
+
+CFlatTree* CBatchRenderer::getFlatTree(EUtilisationMetric metric)
+{
+	std::unique_ptr<CFlatTree>& flatTree = _flatTrees[static_cast<uint32_t>(metric)];
+	if (!flatTree)
+	{
+		flatTree.reset(new CFlatTree());
+		flatTree->build(_root);
+		flatTree->setUtilisationMetric(metric);
+		flatTree->recursivelyCalculateSize();
+		flatTree->sort();
+	}
+	return flatTree.get();
+}
+
+bool CBatchRenderer::renderGallery(CThreadPool& pool, const char* filename)
+{
+	std::vector<std::pair<CFpgaItem*, std::string>> items;
+	items.push_back(std::make_pair(_root, getItemLabel(_root)));
+	for (uint32_t c = 0; c < _root->getNumChildren(); c++)
+	{
+		CFpgaItem* child = _root->getChildByIndex(c);
+		items.push_back(std::make_pair(child, std::to_string(c) + "-" + getItemLabel(child)));
+	}
+
+	// built up front, the jobs only read them
+	if (_useFlatTree)
+	{
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			getFlatTree(static_cast<EUtilisationMetric>(m));
+		}
+	}
+
+	std::atomic<bool> failed(false);
+	CThreadPool::CTaskGroup group;
+	for (const std::pair<CFpgaItem*, std::string>& item : items)
+	{
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			const EUtilisationMetric metric = static_cast<EUtilisationMetric>(m);
+			const std::string variant = getVariantFilename(filename, item.second, metric);
+			CFpgaItem* itemToDraw = item.first;
+			pool.submit(group, [this, itemToDraw, metric, variant, &failed]()
+			{
+				// There are enough images to keep every thread busy, tiling
+				// each of them as well would only add waiting
+				if (!render(itemToDraw, metric, variant.c_str(), NULL))
+				{
+					failed = true;
+				}
+			});
+		}
+	}
+	pool.wait(group);
+
+	return !failed;
+}
+
+const char* CBatchRenderer::getMetricName(EUtilisationMetric metric)
+{
+	return METRIC_NAMES[static_cast<uint32_t>(metric)];
+}
+
+bool CBatchRenderer::parseMetric(const char* name, EUtilisationMetric& metric)
+{
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		if (strcasecmp(name, METRIC_NAMES[m]) == 0)
+		{
+			metric = static_cast<EUtilisationMetric>(m);
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string CBatchRenderer::getItemLabel(const CFpgaItem* item)
+{
+	std::string label;
+	for (uint32_t i = 0; i < item->getName().getLength(); i++)
+	{
+		const char c = item->getName()[i];
+		label += isalnum((unsigned char) c) || c == '-' || c == '_' ? c : '_';
+	}
+	return label;
+}
+
+std::string CBatchRenderer::getVariantFilename(const char* filename, const std::string& label, EUtilisationMetric metric)
+{
+	std::string variant(filename);
+	const size_t slash = variant.rfind('/');
+	size_t dot = variant.rfind('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		dot = variant.size();
+	}
+	return variant.insert(dot, "_" + label + "_" + getMetricName(metric));
+}
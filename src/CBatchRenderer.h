@@ -0,0 +1,69 @@
+#ifndef SRC_CBATCHRENDERER_H_
+#define SRC_CBATCHRENDERER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "EUtilisationMetric.h"
+
+class CFlatTree;
+class CFpgaItem;
+class CThreadPool;
+
+// Renders treemaps straight to image files, without a display. Nothing
+// here touches SDL or X11.
+class CBatchRenderer
+{
+public:
+	CBatchRenderer(CFpgaItem* root, uint32_t width, uint32_t height);
+	~CBatchRenderer();
+
+	// shared by the tiles of each render, may be NULL
+	void setThreadPool(CThreadPool* pool);
+	// see CTreeMap::Options::lodArea, 0 by default
+	void setLodArea(uint32_t lodArea);
+	// Copy the tree into a CFlatTree once per metric and lay every image
+	// of that metric out through CFlatTree::View instead of CFpgaView,
+	// off by default. Experimental: the copy costs more than the faster
+	// layout saves unless there are many images.
+	void setUseFlatTree(bool useFlatTree);
+
+	// the first item in preorder with that name, whatever its size
+	CFpgaItem* findItem(const char* name) const;
+
+	// the format follows the extension, see CImageWriter
+	bool render(CFpgaItem* item, EUtilisationMetric metric, const char* filename);
+
+	// Every metric of the root and of each of its children, one job per
+	// image on the pool. The children are labelled with their index as
+	// well, sibling names needn't be unique.
+	bool renderGallery(CThreadPool& pool, const char* filename);
+
+	// lower case names as given on the command line: slice, reg, ...
+	static const char* getMetricName(EUtilisationMetric metric);
+	static bool parseMetric(const char* name, EUtilisationMetric& metric);
+
+	// the item's name with anything but letters, digits, '-' and '_'
+	// replaced by '_'
+	static std::string getItemLabel(const CFpgaItem* item);
+	// filename with "_<label>_<metric>" inserted before the extension
+	static std::string getVariantFilename(const char* filename, const std::string& label, EUtilisationMetric metric);
+
+private:
+	static CFpgaItem* findItem(CFpgaItem* item, const char* name);
+	// pool is used for the tiles of this image only
+	bool render(CFpgaItem* item, EUtilisationMetric metric, const char* filename, CThreadPool* pool);
+	// the whole tree sized and sorted for metric, built on first use
+	CFlatTree* getFlatTree(EUtilisationMetric metric);
+
+	CFpgaItem* _root;
+	uint32_t _width;
+	uint32_t _height;
+	CThreadPool* _threadPool;
+	uint32_t _lodArea;
+	bool _useFlatTree;
+	std::unique_ptr<CFlatTree> _flatTrees[NUM_UTILISATION_METRICS];
+};
+
+#endif /* SRC_CBATCHRENDERER_H_ */
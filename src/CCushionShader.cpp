@@ -0,0 +1,739 @@
+#include "CCushionShader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "windirstat/CColorSpace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CUSHION_SHADER_X86
+#include <immintrin.h>
+#endif
+
+CCushionShader::EImplementation CCushionShader::_implementation = CCushionShader::detectImplementation();
+
+CCushionShader::ShadeRowFunction CCushionShader::_shadeRow = NULL;
+
+CCushionShader::ShadeSeparableRowFunction CCushionShader::_shadeSeparableRow = NULL;
+
+CCushionShader::EMode CCushionShader::_mode = CCushionShader::EMode::SEPARABLE;
+
+namespace
+{
+
+inline uint32_t getRed(uint32_t colour)
+{
+	return colour & 0xff;
+}
+
+inline uint32_t getGreen(uint32_t colour)
+{
+	return (colour >> 8) & 0xff;
+}
+
+inline uint32_t getBlue(uint32_t colour)
+{
+	return (colour >> 16) & 0xff;
+}
+
+// The rest of the reference calculation once cosa is known
+inline uint32_t shadePixel(double cosa, double Is, double Ia, double brightness, double colR, double colG, double colB)
+{
+	if (cosa > 1.0)
+	{
+		cosa = 1.0;
+	}
+
+	double pixel = Is * cosa;
+	if (pixel < 0)
+	{
+		pixel = 0;
+	}
+
+	pixel += Ia;
+	assert(pixel <= 1.0);
+
+	// Now, pixel is the brightness of the pixel, 0...1.0.
+
+	// Apply contrast.
+	// Not implemented.
+	// Costs performance and nearly the same effect can be
+	// made width the m_options->ambientLight parameter.
+	// pixel = pow(pixel, m_options->contrast);
+
+	// Apply "brightness"
+	pixel *= brightness;
+
+	// Make color value
+	int red = (int) (colR * pixel);
+	int green = (int) (colG * pixel);
+	int blue = (int) (colB * pixel);
+
+	CColorSpace::NormalizeColor(red, green, blue);
+
+	// ... and set!
+	return (uint8_t) blue | ((uint8_t) green << 8) | ((uint8_t) red << 16);
+}
+
+// Index into a LOOKUP table
+inline uint32_t getLookupIndex(double cosa)
+{
+	if (cosa <= 0)
+	{
+		return 0;
+	}
+	if (cosa >= 1.0)
+	{
+		return CCushionShader::LOOKUP_SIZE - 1;
+	}
+	return (uint32_t) (cosa * (CCushionShader::LOOKUP_SIZE - 1) + 0.5);
+}
+
+struct SLookup
+{
+	bool valid;
+	uint32_t colour;
+	double brightness;
+	double ambientLight;
+	uint32_t pixels[CCushionShader::LOOKUP_SIZE];
+};
+
+// Searched in full and replaced round robin. The palette has 13 colours
+// and few items are drawn darker or lighter, so this rarely misses.
+const uint32_t LOOKUP_CACHE_SIZE = 16;
+
+thread_local SLookup* _LookupCache = NULL;
+thread_local uint32_t _LookupCacheNext = 0;
+
+// Narrower rectangles are shaded PER_PIXEL
+const int32_t SEPARABLE_MIN_WIDTH = 8;
+
+// Column terms of the rectangle being shaded
+thread_local std::vector<float> _ColumnLight;
+thread_local std::vector<float> _ColumnSquared;
+
+// Per row constants of the vector versions. nx is linear along the row, so
+// it is stepped from its value at the cushion's left edge rather than
+// computed from x, which would lose too much precision in float far from the
+// origin. Always the same edge, so a pixel doesn't depend on where a row is
+// cut. The separable versions only use the row terms and the colour.
+struct SRowConstants
+{
+	float nx0;
+	float dnx;
+	float nyLyPlusLz;
+	float nySquaredPlusOne;
+	float lx;
+	float shading;
+	float ambientLight;
+	float brightness;
+	float red;
+	float green;
+	float blue;
+};
+
+inline void getRowConstants(const CCushionShader::SParameters& p, double nyLyPlusLz, double nySquaredPlusOne, double nx0, SRowConstants& c)
+{
+	c.nx0 = nx0;
+	c.dnx = -2 * p.surface[0];
+	c.nyLyPlusLz = nyLyPlusLz;
+	c.nySquaredPlusOne = nySquaredPlusOne;
+	c.lx = p.lx;
+	c.shading = 1 - p.ambientLight;
+	c.ambientLight = p.ambientLight;
+	c.brightness = p.brightness;
+	c.red = getRed(p.colour);
+	c.green = getGreen(p.colour);
+	c.blue = getBlue(p.colour);
+}
+
+inline void getRowConstants(const CCushionShader::SParameters& p, int32_t y, int32_t origin, SRowConstants& c)
+{
+	const double ny = -(2 * p.surface[1] * (y + 0.5) + p.surface[3]);
+	getRowConstants(p, ny * p.ly + p.lz, ny * ny + 1.0, -(2 * p.surface[0] * (origin + 0.5) + p.surface[2]), c);
+}
+
+}
+
+CCushionShader::EImplementation CCushionShader::detectImplementation()
+{
+#ifdef CUSHION_SHADER_X86
+	// we may run before the constructors that normally do this
+	__builtin_cpu_init();
+#endif
+
+	EImplementation implementation = EImplementation::SCALAR;
+	if (isSupported(EImplementation::AVX2))
+	{
+		implementation = EImplementation::AVX2;
+	}
+	else if (isSupported(EImplementation::SSE41))
+	{
+		implementation = EImplementation::SSE41;
+	}
+	setImplementation(implementation);
+	return implementation;
+}
+
+CCushionShader::EImplementation CCushionShader::getImplementation()
+{
+	return _implementation;
+}
+
+bool CCushionShader::setImplementation(EImplementation implementation)
+{
+	if (!isSupported(implementation))
+	{
+		return false;
+	}
+
+	_implementation = implementation;
+	switch (implementation)
+	{
+		case EImplementation::AVX2:
+			_shadeRow = &shadeRowAvx2;
+			_shadeSeparableRow = &shadeSeparableRowAvx2;
+			break;
+		case EImplementation::SSE41:
+			_shadeRow = &shadeRowSse41;
+			_shadeSeparableRow = &shadeSeparableRowSse41;
+			break;
+		default:
+			_shadeRow = &shadeRowScalar;
+			_shadeSeparableRow = &shadeSeparableRowScalar;
+			break;
+	}
+	return true;
+}
+
+bool CCushionShader::isSupported(EImplementation implementation)
+{
+	switch (implementation)
+	{
+#ifdef CUSHION_SHADER_X86
+		case EImplementation::AVX2:
+			return __builtin_cpu_supports("avx2");
+		case EImplementation::SSE41:
+			return __builtin_cpu_supports("sse4.1");
+#endif
+		case EImplementation::SCALAR:
+			return true;
+		default:
+			return false;
+	}
+}
+
+void CCushionShader::shadeRowScalar(const SParameters& parameters, int32_t y, int32_t /*origin*/, int32_t left, int32_t right, uint32_t* row)
+{
+	const double* surface = parameters.surface;
+
+	// Cushion parameters
+	const double Ia = parameters.ambientLight;
+
+	// Derived parameters
+	const double Is = 1 - Ia;   // shading
+
+	const double colR = getRed(parameters.colour);
+	const double colG = getGreen(parameters.colour);
+	const double colB = getBlue(parameters.colour);
+
+	for (int32_t ix = left; ix < right; ix++)
+	{
+		double nx = -(2 * surface[0] * (ix + 0.5) + surface[2]);
+		double ny = -(2 * surface[1] * (y + 0.5) + surface[3]);
+		double cosa = (nx * parameters.lx + ny * parameters.ly + parameters.lz) / sqrt(nx * nx + ny * ny + 1.0);
+		row[ix] = shadePixel(cosa, Is, Ia, parameters.brightness, colR, colG, colB);
+	}
+}
+
+CCushionShader::EMode CCushionShader::getMode()
+{
+	return _mode;
+}
+
+void CCushionShader::setMode(EMode mode)
+{
+	_mode = mode;
+}
+
+void CCushionShader::shadeRect(const SParameters& parameters, int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t* screen, uint32_t pitch)
+{
+	shadeRect(parameters, left, top, right, bottom, left, top, right, bottom, screen, pitch);
+}
+
+void CCushionShader::shadeRect(const SParameters& parameters, int32_t left, int32_t top, int32_t right, int32_t bottom, int32_t clipLeft, int32_t clipTop, int32_t clipRight, int32_t clipBottom, uint32_t* screen, uint32_t pitch)
+{
+	clipLeft = std::max(clipLeft, left);
+	clipTop = std::max(clipTop, top);
+	clipRight = std::min(clipRight, right);
+	clipBottom = std::min(clipBottom, bottom);
+	if (clipRight <= clipLeft || clipBottom <= clipTop)
+	{
+		return;
+	}
+
+	// Below a vector's width setting up the columns costs more than it
+	// saves. Decided on the whole cushion, so all its parts agree.
+	if (_mode == EMode::PER_PIXEL || right - left < SEPARABLE_MIN_WIDTH)
+	{
+		for (int32_t y = clipTop; y < clipBottom; y++)
+		{
+			shadeRow(parameters, y, left, clipLeft, clipRight, screen + y * pitch);
+		}
+		return;
+	}
+
+	// The normal is (nx, ny, 1) with nx linear in x and ny linear in y. So
+	// nx * lx and nx * nx only change with the column, and are stepped along
+	// it with first and second differences instead of being worked out for
+	// every pixel. The same goes for ny down the rows. Both start from the
+	// cushion's edges, whatever the clip, so the sums are the same for every
+	// part of it.
+	// Padded to whole vectors, so the kernels can read past width
+	const int32_t offset = clipLeft - left;
+	const int32_t width = clipRight - clipLeft;
+	const int32_t columns = offset + ((width + 7) & ~7);
+	_ColumnLight.resize(columns);
+	_ColumnSquared.resize(columns);
+
+	const double* surface = parameters.surface;
+	const double dnx = -2 * surface[0];
+	double nx = -(2 * surface[0] * (left + 0.5) + surface[2]);
+	double nxSquared = nx * nx;
+	double nxSquaredDelta = 2 * nx * dnx + dnx * dnx;
+	for (int32_t i = 0; i < columns; i++)
+	{
+		_ColumnLight[i] = nx * parameters.lx;
+		_ColumnSquared[i] = nxSquared;
+		nx += dnx;
+		nxSquared += nxSquaredDelta;
+		nxSquaredDelta += 2 * dnx * dnx;
+	}
+
+	const uint32_t* lookup = _mode == EMode::LOOKUP ? getLookup(parameters) : NULL;
+
+	const double dny = -2 * surface[1];
+	double ny = -(2 * surface[1] * (top + 0.5) + surface[3]);
+	double nySquared = ny * ny;
+	double nySquaredDelta = 2 * ny * dny + dny * dny;
+	for (int32_t y = top; y < clipBottom; y++)
+	{
+		if (y >= clipTop)
+		{
+			const SRowTerms rowTerms = { ny * parameters.ly + parameters.lz, nySquared + 1.0 };
+			uint32_t* row = screen + y * pitch;
+			_shadeSeparableRow(parameters, rowTerms, _ColumnLight.data() + offset, _ColumnSquared.data() + offset, width, lookup, row + clipLeft);
+#ifdef _DEBUG
+			checkRow(parameters, y, clipLeft, clipRight, row, lookup ? MAX_LOOKUP_CHANNEL_ERROR : MAX_CHANNEL_ERROR);
+#endif
+		}
+		ny += dny;
+		nySquared += nySquaredDelta;
+		nySquaredDelta += 2 * dny * dny;
+	}
+}
+
+const uint32_t* CCushionShader::getLookup(const SParameters& parameters)
+{
+	if (!_LookupCache)
+	{
+		// never freed, one per rendering thread
+		_LookupCache = new SLookup[LOOKUP_CACHE_SIZE]();
+	}
+
+	for (uint32_t i = 0; i < LOOKUP_CACHE_SIZE; i++)
+	{
+		const SLookup& lookup = _LookupCache[i];
+		if (lookup.valid && lookup.colour == parameters.colour && lookup.brightness == parameters.brightness && lookup.ambientLight == parameters.ambientLight)
+		{
+			return lookup.pixels;
+		}
+	}
+
+	SLookup& lookup = _LookupCache[_LookupCacheNext];
+	_LookupCacheNext = (_LookupCacheNext + 1) % LOOKUP_CACHE_SIZE;
+
+	const double Ia = parameters.ambientLight;
+	const double Is = 1 - Ia;
+	const double colR = getRed(parameters.colour);
+	const double colG = getGreen(parameters.colour);
+	const double colB = getBlue(parameters.colour);
+	for (uint32_t i = 0; i < LOOKUP_SIZE; i++)
+	{
+		lookup.pixels[i] = shadePixel(i / (double) (LOOKUP_SIZE - 1), Is, Ia, parameters.brightness, colR, colG, colB);
+	}
+	lookup.valid = true;
+	lookup.colour = parameters.colour;
+	lookup.brightness = parameters.brightness;
+	lookup.ambientLight = parameters.ambientLight;
+	return lookup.pixels;
+}
+
+void CCushionShader::shadeSeparableRowScalar(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row)
+{
+	if (lookup)
+	{
+		for (int32_t i = 0; i < width; i++)
+		{
+			const double cosa = (columnLight[i] + rowTerms.nyLyPlusLz) / sqrt(columnSquared[i] + rowTerms.nySquaredPlusOne);
+			row[i] = lookup[getLookupIndex(cosa)];
+		}
+		return;
+	}
+
+	const double Ia = parameters.ambientLight;
+	const double Is = 1 - Ia;
+	const double colR = getRed(parameters.colour);
+	const double colG = getGreen(parameters.colour);
+	const double colB = getBlue(parameters.colour);
+	for (int32_t i = 0; i < width; i++)
+	{
+		const double cosa = (columnLight[i] + rowTerms.nyLyPlusLz) / sqrt(columnSquared[i] + rowTerms.nySquaredPlusOne);
+		row[i] = shadePixel(cosa, Is, Ia, parameters.brightness, colR, colG, colB);
+	}
+}
+
+#ifdef CUSHION_SHADER_X86
+
+namespace
+{
+
+// CColorSpace::DistributeFirst() on every lane, the caller picks the lanes
+__attribute__((target("sse4.1")))
+inline void distributeFirstSse41(__m128i& first, __m128i& second, __m128i& third)
+{
+	const __m128i max = _mm_set1_epi32(255);
+	const __m128i h = _mm_srai_epi32(_mm_sub_epi32(first, max), 1);
+	first = max;
+	second = _mm_add_epi32(second, h);
+	third = _mm_add_epi32(third, h);
+
+	const __m128i secondOver = _mm_cmpgt_epi32(second, max);
+	third = _mm_add_epi32(third, _mm_and_si128(secondOver, _mm_sub_epi32(second, max)));
+	second = _mm_min_epi32(second, max);
+
+	const __m128i thirdOver = _mm_andnot_si128(secondOver, _mm_cmpgt_epi32(third, max));
+	second = _mm_add_epi32(second, _mm_and_si128(thirdOver, _mm_sub_epi32(third, max)));
+	third = _mm_min_epi32(third, max);
+}
+
+// CColorSpace::NormalizeColor() and packing to BGR for 4 pixels
+__attribute__((target("sse4.1")))
+inline __m128i normalizeAndPackSse41(__m128i red, __m128i green, __m128i blue)
+{
+	const __m128i max = _mm_set1_epi32(255);
+	const __m128i redOver = _mm_cmpgt_epi32(red, max);
+	const __m128i greenOver = _mm_andnot_si128(redOver, _mm_cmpgt_epi32(green, max));
+	const __m128i blueOver = _mm_andnot_si128(_mm_or_si128(redOver, greenOver), _mm_cmpgt_epi32(blue, max));
+
+	if (!_mm_testz_si128(_mm_or_si128(redOver, _mm_or_si128(greenOver, blueOver)), _mm_set1_epi32(-1)))
+	{
+		__m128i r1 = red, g1 = green, b1 = blue;
+		distributeFirstSse41(r1, g1, b1);
+		__m128i r2 = red, g2 = green, b2 = blue;
+		distributeFirstSse41(g2, r2, b2);
+		__m128i r3 = red, g3 = green, b3 = blue;
+		distributeFirstSse41(b3, r3, g3);
+
+		red = _mm_blendv_epi8(_mm_blendv_epi8(_mm_blendv_epi8(red, r1, redOver), r2, greenOver), r3, blueOver);
+		green = _mm_blendv_epi8(_mm_blendv_epi8(_mm_blendv_epi8(green, g1, redOver), g2, greenOver), g3, blueOver);
+		blue = _mm_blendv_epi8(_mm_blendv_epi8(_mm_blendv_epi8(blue, b1, redOver), b2, greenOver), b3, blueOver);
+	}
+
+	return _mm_or_si128(blue, _mm_or_si128(_mm_slli_epi32(green, 8), _mm_slli_epi32(red, 16)));
+}
+
+// 1 / sqrt(x), rsqrt is good to 12 bits, one Newton-Raphson step brings it to 22
+__attribute__((target("sse4.1")))
+inline __m128 rsqrtSse41(__m128 x)
+{
+	const __m128 r = _mm_rsqrt_ps(x);
+	return _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(r, r))));
+}
+
+__attribute__((target("sse4.1")))
+inline __m128i colourSse41(const SRowConstants& c, __m128 cosa)
+{
+	cosa = _mm_min_ps(cosa, _mm_set1_ps(1.0f));
+	__m128 pixel = _mm_max_ps(_mm_mul_ps(_mm_set1_ps(c.shading), cosa), _mm_setzero_ps());
+	pixel = _mm_mul_ps(_mm_add_ps(pixel, _mm_set1_ps(c.ambientLight)), _mm_set1_ps(c.brightness));
+
+	const __m128i red = _mm_cvttps_epi32(_mm_mul_ps(_mm_set1_ps(c.red), pixel));
+	const __m128i green = _mm_cvttps_epi32(_mm_mul_ps(_mm_set1_ps(c.green), pixel));
+	const __m128i blue = _mm_cvttps_epi32(_mm_mul_ps(_mm_set1_ps(c.blue), pixel));
+	return normalizeAndPackSse41(red, green, blue);
+}
+
+// Same rounding as getLookupIndex(), there is no gather so the loads are scalar
+__attribute__((target("sse4.1")))
+inline __m128i lookupSse41(const uint32_t* lookup, __m128 cosa)
+{
+	cosa = _mm_max_ps(_mm_min_ps(cosa, _mm_set1_ps(1.0f)), _mm_setzero_ps());
+	const __m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cosa, _mm_set1_ps(CCushionShader::LOOKUP_SIZE - 1)), _mm_set1_ps(0.5f)));
+	return _mm_setr_epi32(lookup[_mm_extract_epi32(index, 0)], lookup[_mm_extract_epi32(index, 1)], lookup[_mm_extract_epi32(index, 2)], lookup[_mm_extract_epi32(index, 3)]);
+}
+
+__attribute__((target("sse4.1")))
+inline __m128i shadeSse41(const SRowConstants& c, __m128 i)
+{
+	const __m128 nx = _mm_add_ps(_mm_set1_ps(c.nx0), _mm_mul_ps(_mm_set1_ps(c.dnx), i));
+	const __m128 lengthSquared = _mm_add_ps(_mm_mul_ps(nx, nx), _mm_set1_ps(c.nySquaredPlusOne));
+	const __m128 cosa = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(c.lx)), _mm_set1_ps(c.nyLyPlusLz)), rsqrtSse41(lengthSquared));
+	return colourSse41(c, cosa);
+}
+
+__attribute__((target("sse4.1")))
+inline __m128 separableCosaSse41(const SRowConstants& c, const float* columnLight, const float* columnSquared)
+{
+	const __m128 lengthSquared = _mm_add_ps(_mm_loadu_ps(columnSquared), _mm_set1_ps(c.nySquaredPlusOne));
+	return _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(columnLight), _mm_set1_ps(c.nyLyPlusLz)), rsqrtSse41(lengthSquared));
+}
+
+__attribute__((target("avx2")))
+inline void distributeFirstAvx2(__m256i& first, __m256i& second, __m256i& third)
+{
+	const __m256i max = _mm256_set1_epi32(255);
+	const __m256i h = _mm256_srai_epi32(_mm256_sub_epi32(first, max), 1);
+	first = max;
+	second = _mm256_add_epi32(second, h);
+	third = _mm256_add_epi32(third, h);
+
+	const __m256i secondOver = _mm256_cmpgt_epi32(second, max);
+	third = _mm256_add_epi32(third, _mm256_and_si256(secondOver, _mm256_sub_epi32(second, max)));
+	second = _mm256_min_epi32(second, max);
+
+	const __m256i thirdOver = _mm256_andnot_si256(secondOver, _mm256_cmpgt_epi32(third, max));
+	second = _mm256_add_epi32(second, _mm256_and_si256(thirdOver, _mm256_sub_epi32(third, max)));
+	third = _mm256_min_epi32(third, max);
+}
+
+__attribute__((target("avx2")))
+inline __m256i normalizeAndPackAvx2(__m256i red, __m256i green, __m256i blue)
+{
+	const __m256i max = _mm256_set1_epi32(255);
+	const __m256i redOver = _mm256_cmpgt_epi32(red, max);
+	const __m256i greenOver = _mm256_andnot_si256(redOver, _mm256_cmpgt_epi32(green, max));
+	const __m256i blueOver = _mm256_andnot_si256(_mm256_or_si256(redOver, greenOver), _mm256_cmpgt_epi32(blue, max));
+
+	if (!_mm256_testz_si256(_mm256_or_si256(redOver, _mm256_or_si256(greenOver, blueOver)), _mm256_set1_epi32(-1)))
+	{
+		__m256i r1 = red, g1 = green, b1 = blue;
+		distributeFirstAvx2(r1, g1, b1);
+		__m256i r2 = red, g2 = green, b2 = blue;
+		distributeFirstAvx2(g2, r2, b2);
+		__m256i r3 = red, g3 = green, b3 = blue;
+		distributeFirstAvx2(b3, r3, g3);
+
+		red = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(red, r1, redOver), r2, greenOver), r3, blueOver);
+		green = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(green, g1, redOver), g2, greenOver), g3, blueOver);
+		blue = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(blue, b1, redOver), b2, greenOver), b3, blueOver);
+	}
+
+	return _mm256_or_si256(blue, _mm256_or_si256(_mm256_slli_epi32(green, 8), _mm256_slli_epi32(red, 16)));
+}
+
+__attribute__((target("avx2")))
+inline __m256 rsqrtAvx2(__m256 x)
+{
+	const __m256 r = _mm256_rsqrt_ps(x);
+	return _mm256_mul_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x), _mm256_mul_ps(r, r))));
+}
+
+__attribute__((target("avx2")))
+inline __m256i colourAvx2(const SRowConstants& c, __m256 cosa)
+{
+	cosa = _mm256_min_ps(cosa, _mm256_set1_ps(1.0f));
+	__m256 pixel = _mm256_max_ps(_mm256_mul_ps(_mm256_set1_ps(c.shading), cosa), _mm256_setzero_ps());
+	pixel = _mm256_mul_ps(_mm256_add_ps(pixel, _mm256_set1_ps(c.ambientLight)), _mm256_set1_ps(c.brightness));
+
+	const __m256i red = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_set1_ps(c.red), pixel));
+	const __m256i green = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_set1_ps(c.green), pixel));
+	const __m256i blue = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_set1_ps(c.blue), pixel));
+	return normalizeAndPackAvx2(red, green, blue);
+}
+
+__attribute__((target("avx2")))
+inline __m256i lookupAvx2(const uint32_t* lookup, __m256 cosa)
+{
+	cosa = _mm256_max_ps(_mm256_min_ps(cosa, _mm256_set1_ps(1.0f)), _mm256_setzero_ps());
+	const __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(cosa, _mm256_set1_ps(CCushionShader::LOOKUP_SIZE - 1)), _mm256_set1_ps(0.5f)));
+	return _mm256_i32gather_epi32((const int*) lookup, index, 4);
+}
+
+__attribute__((target("avx2")))
+inline __m256i shadeAvx2(const SRowConstants& c, __m256 i)
+{
+	const __m256 nx = _mm256_add_ps(_mm256_set1_ps(c.nx0), _mm256_mul_ps(_mm256_set1_ps(c.dnx), i));
+	const __m256 lengthSquared = _mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_set1_ps(c.nySquaredPlusOne));
+	const __m256 cosa = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_set1_ps(c.lx)), _mm256_set1_ps(c.nyLyPlusLz)), rsqrtAvx2(lengthSquared));
+	return colourAvx2(c, cosa);
+}
+
+__attribute__((target("avx2")))
+inline __m256 separableCosaAvx2(const SRowConstants& c, const float* columnLight, const float* columnSquared)
+{
+	const __m256 lengthSquared = _mm256_add_ps(_mm256_loadu_ps(columnSquared), _mm256_set1_ps(c.nySquaredPlusOne));
+	return _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(columnLight), _mm256_set1_ps(c.nyLyPlusLz)), rsqrtAvx2(lengthSquared));
+}
+
+}
+
+__attribute__((target("sse4.1")))
+void CCushionShader::shadeRowSse41(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row)
+{
+	SRowConstants c;
+	getRowConstants(parameters, y, origin, c);
+
+	const __m128 step = _mm_set1_ps(4.0f);
+	__m128 i = _mm_add_ps(_mm_set1_ps(left - origin), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+	int32_t x = left;
+	for (; x + 8 <= right; x += 8)
+	{
+		_mm_storeu_si128((__m128i*) (row + x), shadeSse41(c, i));
+		i = _mm_add_ps(i, step);
+		_mm_storeu_si128((__m128i*) (row + x + 4), shadeSse41(c, i));
+		i = _mm_add_ps(i, step);
+	}
+	for (; x < right; x += 4)
+	{
+		// the tail is shaded the same way, only the valid lanes are kept
+		uint32_t pixels[4];
+		_mm_storeu_si128((__m128i*) pixels, shadeSse41(c, i));
+		memcpy(row + x, pixels, std::min(4, right - x) * sizeof(uint32_t));
+		i = _mm_add_ps(i, step);
+	}
+}
+
+__attribute__((target("avx2")))
+void CCushionShader::shadeRowAvx2(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row)
+{
+	SRowConstants c;
+	getRowConstants(parameters, y, origin, c);
+
+	const __m256 step = _mm256_set1_ps(8.0f);
+	__m256 i = _mm256_add_ps(_mm256_set1_ps(left - origin), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+	int32_t x = left;
+	for (; x + 8 <= right; x += 8)
+	{
+		_mm256_storeu_si256((__m256i*) (row + x), shadeAvx2(c, i));
+		i = _mm256_add_ps(i, step);
+	}
+	if (x < right)
+	{
+		// the tail is shaded the same way, only the valid lanes are kept
+		uint32_t pixels[8];
+		_mm256_storeu_si256((__m256i*) pixels, shadeAvx2(c, i));
+		memcpy(row + x, pixels, (right - x) * sizeof(uint32_t));
+	}
+}
+
+__attribute__((target("sse4.1")))
+void CCushionShader::shadeSeparableRowSse41(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row)
+{
+	SRowConstants c;
+	getRowConstants(parameters, rowTerms.nyLyPlusLz, rowTerms.nySquaredPlusOne, 0, c);
+
+	int32_t i = 0;
+	if (lookup)
+	{
+		for (; i + 4 <= width; i += 4)
+		{
+			_mm_storeu_si128((__m128i*) (row + i), lookupSse41(lookup, separableCosaSse41(c, columnLight + i, columnSquared + i)));
+		}
+	}
+	else
+	{
+		for (; i + 4 <= width; i += 4)
+		{
+			_mm_storeu_si128((__m128i*) (row + i), colourSse41(c, separableCosaSse41(c, columnLight + i, columnSquared + i)));
+		}
+	}
+	if (i < width)
+	{
+		// the column terms are padded, only the pixels have to be cut off
+		const __m128 cosa = separableCosaSse41(c, columnLight + i, columnSquared + i);
+		uint32_t pixels[4];
+		_mm_storeu_si128((__m128i*) pixels, lookup ? lookupSse41(lookup, cosa) : colourSse41(c, cosa));
+		memcpy(row + i, pixels, (width - i) * sizeof(uint32_t));
+	}
+}
+
+__attribute__((target("avx2")))
+void CCushionShader::shadeSeparableRowAvx2(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row)
+{
+	SRowConstants c;
+	getRowConstants(parameters, rowTerms.nyLyPlusLz, rowTerms.nySquaredPlusOne, 0, c);
+
+	int32_t i = 0;
+	if (lookup)
+	{
+		for (; i + 8 <= width; i += 8)
+		{
+			_mm256_storeu_si256((__m256i*) (row + i), lookupAvx2(lookup, separableCosaAvx2(c, columnLight + i, columnSquared + i)));
+		}
+	}
+	else
+	{
+		for (; i + 8 <= width; i += 8)
+		{
+			_mm256_storeu_si256((__m256i*) (row + i), colourAvx2(c, separableCosaAvx2(c, columnLight + i, columnSquared + i)));
+		}
+	}
+	if (i < width)
+	{
+		// the column terms are padded, only the pixels have to be cut off
+		const __m256 cosa = separableCosaAvx2(c, columnLight + i, columnSquared + i);
+		uint32_t pixels[8];
+		_mm256_storeu_si256((__m256i*) pixels, lookup ? lookupAvx2(lookup, cosa) : colourAvx2(c, cosa));
+		memcpy(row + i, pixels, (width - i) * sizeof(uint32_t));
+	}
+}
+
+#else
+
+void CCushionShader::shadeSeparableRowSse41(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row)
+{
+	shadeSeparableRowScalar(parameters, rowTerms, columnLight, columnSquared, width, lookup, row);
+}
+
+void CCushionShader::shadeSeparableRowAvx2(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row)
+{
+	shadeSeparableRowScalar(parameters, rowTerms, columnLight, columnSquared, width, lookup, row);
+}
+
+void CCushionShader::shadeRowSse41(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row)
+{
+	shadeRowScalar(parameters, y, origin, left, right, row);
+}
+
+void CCushionShader::shadeRowAvx2(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row)
+{
+	shadeRowScalar(parameters, y, origin, left, right, row);
+}
+
+#endif
+
+#ifdef _DEBUG
+void CCushionShader::checkRow(const SParameters& parameters, int32_t y, int32_t left, int32_t right, const uint32_t* row, int32_t maxError)
+{
+	if (right <= left)
+	{
+		return;
+	}
+	uint32_t* reference = new uint32_t[right];
+	shadeRowScalar(parameters, y, left, left, right, reference);
+	for (int32_t x = left; x < right; x++)
+	{
+		for (uint32_t shift = 0; shift < 24; shift += 8)
+		{
+			const int32_t error = (int32_t) ((row[x] >> shift) & 0xff) - (int32_t) ((reference[x] >> shift) & 0xff);
+			assert(std::abs(error) <= maxError);
+		}
+	}
+	delete[] reference;
+}
+#endif
@@ -0,0 +1,116 @@
+#ifndef SRC_CCUSHIONSHADER_H_
+#define SRC_CCUSHIONSHADER_H_
+
+#include <cstdint>
+
+// Shades treemap cushions (see CTreeMap::DrawCushion). The scalar version
+// is the double precision reference, the SSE4.1 and AVX2 versions work in
+// float on 8 pixels at a time and may differ from it by up to
+// MAX_CHANNEL_ERROR per colour channel, LOOKUP by up to
+// MAX_LOOKUP_CHANNEL_ERROR. Every pixel only depends on its position in the
+// cushion, so shading a cushion in clipped parts gives the same pixels as
+// shading it whole. Static members only.
+class CCushionShader
+{
+public:
+	enum class EImplementation
+	{
+		SCALAR,
+		SSE41,
+		AVX2
+	};
+
+	// How shadeRect() evaluates the surface. PER_PIXEL calls shadeRow() for
+	// every row. SEPARABLE works out the column terms of the normal once per
+	// rectangle and the row terms once per row, both by forward differences.
+	// LOOKUP also maps the brightness to a pixel through a table per colour,
+	// which is faster again but changes the look slightly, so it has to be
+	// asked for.
+	enum class EMode
+	{
+		PER_PIXEL,
+		SEPARABLE,
+		LOOKUP
+	};
+
+	struct SParameters
+	{
+		double surface[4];   // see CTreeMap::AddRidge
+		double lx;           // normalised light source
+		double ly;
+		double lz;
+		double ambientLight;
+		double brightness;   // already divided by the palette brightness
+		uint32_t colour;     // RGB, red in the lowest byte
+	};
+
+	static const int32_t MAX_CHANNEL_ERROR = 3;
+	static const int32_t MAX_LOOKUP_CHANNEL_ERROR = 4;
+
+	// Entries in a LOOKUP table, cosa in [0, 1] is rounded to one of them
+	static const uint32_t LOOKUP_SIZE = 2048;
+
+	// Writes BGR pixels for x in [left, right) of row y to row[x]. origin
+	// is the left edge of the cushion, the vector versions step along the
+	// row from there.
+	static void shadeRow(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row);
+
+	// Writes BGR pixels for the part of the cushion [left, right) x
+	// [top, bottom) inside [clipLeft, clipRight) x [clipTop, clipBottom) to
+	// screen, which has pitch pixels per row.
+	static void shadeRect(const SParameters& parameters, int32_t left, int32_t top, int32_t right, int32_t bottom, int32_t clipLeft, int32_t clipTop, int32_t clipRight, int32_t clipBottom, uint32_t* screen, uint32_t pitch);
+	// The whole cushion
+	static void shadeRect(const SParameters& parameters, int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t* screen, uint32_t pitch);
+
+	// Implementation picked at startup, can be overridden for comparisons.
+	static EImplementation getImplementation();
+	static bool setImplementation(EImplementation implementation);
+	static bool isSupported(EImplementation implementation);
+
+	static EMode getMode();
+	static void setMode(EMode mode);
+
+	static void shadeRowScalar(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row);
+	static void shadeRowSse41(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row);
+	static void shadeRowAvx2(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row);
+
+private:
+	// Terms of the normal that only depend on the row, see shadeRect()
+	struct SRowTerms
+	{
+		double nyLyPlusLz;
+		double nySquaredPlusOne;
+	};
+
+	typedef void (*ShadeRowFunction)(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row);
+	// columnLight and columnSquared hold width terms, padded to a multiple of 8
+	typedef void (*ShadeSeparableRowFunction)(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row);
+
+	static void shadeSeparableRowScalar(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row);
+	static void shadeSeparableRowSse41(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row);
+	static void shadeSeparableRowAvx2(const SParameters& parameters, const SRowTerms& rowTerms, const float* columnLight, const float* columnSquared, int32_t width, const uint32_t* lookup, uint32_t* row);
+
+	// The table for parameters' colour, brightness and ambient light, kept
+	// in a small cache per thread
+	static const uint32_t* getLookup(const SParameters& parameters);
+
+	static EImplementation detectImplementation();
+#ifdef _DEBUG
+	static void checkRow(const SParameters& parameters, int32_t y, int32_t left, int32_t right, const uint32_t* row, int32_t maxError);
+#endif
+
+	static EImplementation _implementation;
+	static ShadeRowFunction _shadeRow;
+	static ShadeSeparableRowFunction _shadeSeparableRow;
+	static EMode _mode;
+};
+
+inline void CCushionShader::shadeRow(const SParameters& parameters, int32_t y, int32_t origin, int32_t left, int32_t right, uint32_t* row)
+{
+	_shadeRow(parameters, y, origin, left, right, row);
+#ifdef _DEBUG
+	checkRow(parameters, y, left, right, row, MAX_CHANNEL_ERROR);
+#endif
+}
+
+#endif /* SRC_CCUSHIONSHADER_H_ */
@@ -0,0 +1,143 @@
+#include "CDesignSummaryMatcher.h"
+
+#include <cstring>
+
+static const char KEY_PREFIX[] = "Number of ";
+static const uint32_t KEY_PREFIX_LENGTH = sizeof(KEY_PREFIX) - 1;
+
+CDesignSummaryMatcher::CDesignSummaryMatcher() :
+		_tableMask(0)
+{
+	rebuildTable();
+}
+
+CDesignSummaryMatcher::~CDesignSummaryMatcher()
+{
+
+}
+
+void CDesignSummaryMatcher::addKey(const char* key, uint32_t id)
+{
+	SEntry entry;
+	entry.key = CStringSpan(key);
+	entry.hash = entry.key.hash();
+	entry.id = id;
+	_keys.push_back(entry);
+	rebuildTable();
+}
+
+int32_t CDesignSummaryMatcher::match(const CStringSpan& line, CStringSpan& values) const
+{
+	// at least two spaces of indentation, then "Number of "
+	uint32_t pos = 0;
+	while (pos < line.getLength() && line[pos] == ' ')
+	{
+		pos++;
+	}
+	if (pos < 2 || line.getLength() - pos < KEY_PREFIX_LENGTH || memcmp(line.getData() + pos, KEY_PREFIX, KEY_PREFIX_LENGTH) != 0)
+	{
+		return -1;
+	}
+	pos += KEY_PREFIX_LENGTH;
+
+	const char* keyStart = line.getData() + pos;
+	const char* colon = static_cast<const char*>(memchr(keyStart, ':', line.getLength() - pos));
+	if (colon == NULL)
+	{
+		return -1;
+	}
+	const uint32_t keyLength = colon - keyStart;
+
+	// the value column is separated from the colon by at least two spaces
+	const CStringSpan afterKey = line.substr(pos + keyLength + 1);
+	if (afterKey.getLength() < 2 || afterKey[0] != ' ' || afterKey[1] != ' ')
+	{
+		return -1;
+	}
+
+	const uint32_t keyHash = CStringSpan(keyStart, keyLength).hash();
+	for (uint32_t slot = keyHash & _tableMask; _table[slot].id >= 0; slot = (slot + 1) & _tableMask)
+	{
+		const SEntry& entry = _table[slot];
+		if (entry.hash == keyHash && entry.key.getLength() == keyLength && memcmp(entry.key.getData(), keyStart, keyLength) == 0)
+		{
+			values = afterKey.substr(2);
+			return entry.id;
+		}
+	}
+	return -1;
+}
+
+void CDesignSummaryMatcher::parseUsedAndTotal(const CStringSpan& values, uint32_t& used, uint32_t& total)
+{
+	// Digits are collected ignoring any punctuation or words, spaces end a
+	// number: "1,234 out of 5,678" holds the numbers 1234 and 5678.
+	uint32_t numbers[2] = { 0, 0 };
+	uint32_t numNumbers = 0;
+	bool inNumber = false;
+	for (uint32_t i = 0; i < values.getLength() && numNumbers < 2; i++)
+	{
+		const char c = values[i];
+		if (c >= '0' && c <= '9')
+		{
+			numbers[numNumbers] = numbers[numNumbers] * 10 + (c - '0');
+			inNumber = true;
+		}
+		else if (c == ' ' && inNumber)
+		{
+			numNumbers++;
+			inNumber = false;
+		}
+	}
+	if (inNumber)
+	{
+		numNumbers++;
+	}
+
+	used = numbers[0];
+	if (numNumbers > 1)
+	{
+		total = numbers[1];
+	}
+}
+
+void CDesignSummaryMatcher::rebuildTable()
+{
+	// Grow the table until every key lands in its own slot. The probing in
+	// match() only matters if that never happens within a sane size.
+	static const uint32_t MAX_TABLE_SIZE = 1 << 16;
+
+	SEntry empty;
+	empty.hash = 0;
+	empty.id = -1;
+
+	uint32_t tableSize = 4;
+	while (tableSize < 2 * _keys.size())
+	{
+		tableSize *= 2;
+	}
+
+	while (1)
+	{
+		_table.assign(tableSize, empty);
+		_tableMask = tableSize - 1;
+
+		bool collision = false;
+		for (const auto& key : _keys)
+		{
+			uint32_t slot = key.hash & _tableMask;
+			while (_table[slot].id >= 0)
+			{
+				collision = true;
+				slot = (slot + 1) & _tableMask;
+			}
+			_table[slot] = key;
+		}
+
+		if (!collision || tableSize >= MAX_TABLE_SIZE)
+		{
+			break;
+		}
+		tableSize *= 2;
+	}
+}
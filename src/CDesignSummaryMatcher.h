@@ -0,0 +1,45 @@
+#ifndef SRC_CDESIGNSUMMARYMATCHER_H_
+#define SRC_CDESIGNSUMMARYMATCHER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "CStringSpan.h"
+
+// Recognises the "  Number of <key>:  <used> out of <total>" lines of a map
+// report Design Summary in a single pass. Keys are looked up in a hash table
+// sized at registration time so that no two keys share a slot, so matching a
+// line costs one hash and one compare however many keys are registered.
+class CDesignSummaryMatcher
+{
+public:
+	CDesignSummaryMatcher();
+	~CDesignSummaryMatcher();
+
+	// key is the text between "Number of " and ':', e.g. "Slice LUTs"
+	void addKey(const char* key, uint32_t id);
+
+	// Returns the id of the line's key, or -1 when it is not a known
+	// resource line. values receives the text after the key.
+	int32_t match(const CStringSpan& line, CStringSpan& values) const;
+
+	// "1,234 out of 5,678  21%" -> 1234, 5678. total is left alone when the
+	// line has no second number.
+	static void parseUsedAndTotal(const CStringSpan& values, uint32_t& used, uint32_t& total);
+
+private:
+	struct SEntry
+	{
+		CStringSpan key;
+		uint32_t hash;
+		int32_t id;
+	};
+
+	void rebuildTable();
+
+	std::vector<SEntry> _keys;
+	std::vector<SEntry> _table;
+	uint32_t _tableMask;
+};
+
+#endif /* SRC_CDESIGNSUMMARYMATCHER_H_ */
@@ -0,0 +1,221 @@
+#include "CFlatTree.h"
+
+#include <algorithm>
+
+#include "CFpgaItem.h"
+
+CFlatTree::Item::Item(CFlatTree* tree, uint32_t node) :
+		_tree(tree),
+		_node(node)
+{
+
+}
+
+uint32_t CFlatTree::Item::getNode() const
+{
+	return _node;
+}
+
+bool CFlatTree::Item::TmiIsLeaf() const
+{
+	return _tree->getNumVisibleChildren(_node) == 0;
+}
+
+uint32_t CFlatTree::Item::TmiGetGraphColor() const
+{
+	return _tree->getColour(_node);
+}
+
+int CFlatTree::Item::TmiGetChildrenCount() const
+{
+	return _tree->getNumVisibleChildren(_node);
+}
+
+CTreeMap::Item* CFlatTree::Item::TmiGetChild(int c) const
+{
+	return _tree->getItem(_tree->getChild(_node, c));
+}
+
+uint64_t CFlatTree::Item::TmiGetLocalSize() const
+{
+	return _tree->getLocalSize(_node);
+}
+
+uint64_t CFlatTree::Item::TmiGetRecursiveSize() const
+{
+	return _tree->getRecursiveSize(_node);
+}
+
+CFlatTree::CFlatTree() :
+		_metric(EUtilisationMetric::REG)
+{
+
+}
+
+CFlatTree::~CFlatTree()
+{
+
+}
+
+void CFlatTree::build(CFpgaItem* root)
+{
+	_parents.clear();
+	_names.clear();
+	_colours.clear();
+	_sources.clear();
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		_localSizes[m].clear();
+	}
+
+	// number the nodes in preorder
+	std::vector<std::pair<CFpgaItem*, uint32_t>> stack;
+	stack.push_back(std::make_pair(root, NO_NODE));
+	while (!stack.empty())
+	{
+		CFpgaItem* item = stack.back().first;
+		uint32_t parent = stack.back().second;
+		stack.pop_back();
+
+		uint32_t node = _parents.size();
+		const CResourceUtilisation& ru = item->getResourceUtilisation();
+		_parents.push_back(parent);
+		_names.push_back(item->getName());
+		_colours.push_back(item->getColour());
+		_sources.push_back(item);
+		_localSizes[static_cast<uint32_t>(EUtilisationMetric::SLICE)].push_back(ru.getSlices());
+		_localSizes[static_cast<uint32_t>(EUtilisationMetric::REG)].push_back(ru.getRegisters());
+		_localSizes[static_cast<uint32_t>(EUtilisationMetric::LUT)].push_back(ru.getLuts());
+		_localSizes[static_cast<uint32_t>(EUtilisationMetric::DSP)].push_back(ru.getDsps());
+		_localSizes[static_cast<uint32_t>(EUtilisationMetric::RAM)].push_back(ru.getRams());
+
+		for (uint32_t c = item->getNumChildren(); c > 0; c--)
+		{
+			stack.push_back(std::make_pair(item->getChildByIndex(c - 1), node));
+		}
+	}
+
+	// child ranges: count, prefix sum, then fill in id (= original) order
+	const uint32_t numNodes = _parents.size();
+	_numChildren.assign(numNodes, 0);
+	for (uint32_t node = 1; node < numNodes; node++)
+	{
+		_numChildren[_parents[node]]++;
+	}
+	_firstChild.assign(numNodes, 0);
+	uint32_t offset = 0;
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		_firstChild[node] = offset;
+		offset += _numChildren[node];
+	}
+	_childList.assign(offset, 0);
+	std::vector<uint32_t> filled(numNodes, 0);
+	for (uint32_t node = 1; node < numNodes; node++)
+	{
+		uint32_t parent = _parents[node];
+		_childList[_firstChild[parent] + filled[parent]++] = node;
+	}
+
+	_numVisibleChildren = _numChildren;
+	_recursiveSizes.assign(numNodes, 0);
+
+	_items.clear();
+	_items.reserve(numNodes);
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		_items.push_back(Item(this, node));
+	}
+}
+
+uint32_t CFlatTree::findNode(const CFpgaItem* item) const
+{
+	if (_sources.empty())
+	{
+		return NO_NODE;
+	}
+	if (item == _sources[0])
+	{
+		return 0;
+	}
+	if (!item->getParent())
+	{
+		return NO_NODE;
+	}
+	// down the path from the root, one child range per level
+	const uint32_t parent = findNode(item->getParent());
+	if (parent == NO_NODE)
+	{
+		return NO_NODE;
+	}
+	for (uint32_t c = 0; c < _numChildren[parent]; c++)
+	{
+		const uint32_t child = getChild(parent, c);
+		if (_sources[child] == item)
+		{
+			return child;
+		}
+	}
+	return NO_NODE;
+}
+
+void CFlatTree::setUtilisationMetric(EUtilisationMetric metric)
+{
+	_metric = metric;
+}
+
+EUtilisationMetric CFlatTree::getUtilisationMetric() const
+{
+	return _metric;
+}
+
+void CFlatTree::recursivelyCalculateSize()
+{
+	// children have higher ids than their parents, so one backwards sweep
+	// has finished every subtree before it is added to its parent
+	const std::vector<uint32_t>& localSizes = _localSizes[static_cast<uint32_t>(_metric)];
+	const uint32_t numNodes = _parents.size();
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		_recursiveSizes[node] = localSizes[node];
+	}
+	for (uint32_t node = numNodes; node-- > 1;)
+	{
+		_recursiveSizes[_parents[node]] += _recursiveSizes[node];
+	}
+}
+
+void CFlatTree::sort()
+{
+	const uint64_t* sizes = _recursiveSizes.data();
+	const uint32_t numNodes = _parents.size();
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		uint32_t* first = _childList.data() + _firstChild[node];
+		uint32_t* last = first + _numChildren[node];
+		std::sort(first, last, [sizes](uint32_t a, uint32_t b)
+		{
+			// rsort, ties keep the order they were added in like CFpgaItem
+			return sizes[a] > sizes[b] || (sizes[a] == sizes[b] && a < b);
+		});
+
+		// zero sized children have been sorted to the end
+		uint32_t visible = _numChildren[node];
+		while (visible > 0 && sizes[first[visible - 1]] == 0)
+		{
+			visible--;
+		}
+		_numVisibleChildren[node] = visible;
+	}
+}
+
+uint32_t CFlatTree::getNumNodes() const
+{
+	return _parents.size();
+}
+
+const CStringSpan& CFlatTree::getName(uint32_t node) const
+{
+	return _names[node];
+}
+
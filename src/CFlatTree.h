@@ -0,0 +1,194 @@
+#ifndef SRC_CFLATTREE_H_
+#define SRC_CFLATTREE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "CResourceUtilisation.h"
+#include "CStringSpan.h"
+#include "EUtilisationMetric.h"
+#include "windirstat/CTreeMap.h"
+
+class CFpgaItem;
+
+// Structure-of-arrays copy of a CFpgaItem hierarchy. Nodes are numbered in
+// preorder, so a parent always has a lower id than its children, and every
+// per-node property lives in its own contiguous array indexed by node id.
+// Sizing is a reverse scan and sorting reorders each node's range of the
+// child list in place. CTreeMap lays it out through CFlatTree::View, the
+// CFlatTree::Item proxies are what it hands back for hit testing. Image
+// export draws through it with -f, see CBatchRenderer::setUseFlatTree().
+// Rectangles stay in CTreeMap's layout rather than in per-node arrays
+// here, so one CFlatTree can be laid out by several treemaps at once.
+class CFlatTree
+{
+public:
+	static const uint32_t NO_NODE = 0xffffffff;
+
+	// CTreeMap::Item view of one node, all state stays in the arrays
+	class Item : public CTreeMap::Item
+	{
+	public:
+		Item(CFlatTree* tree, uint32_t node);
+
+		uint32_t        getNode            () const;
+
+		bool            TmiIsLeaf          () const;
+		uint32_t        TmiGetGraphColor   () const;
+		int             TmiGetChildrenCount() const;
+		CTreeMap::Item* TmiGetChild        (int c) const;
+		uint64_t        TmiGetLocalSize    () const;
+		uint64_t        TmiGetRecursiveSize() const;
+
+	private:
+		CFlatTree* _tree;
+		uint32_t _node;
+	};
+
+	// How CTreeMap's layout sees the tree (see CTreeMap::ItemView),
+	// nodes are ids and every query is a read of one of the arrays
+	class View
+	{
+	public:
+		typedef uint32_t Node;
+
+		View(CFlatTree* tree);
+
+		bool            IsLeaf            (Node node) const;
+		int             GetChildrenCount  (Node node) const;
+		Node            GetChild          (Node node, int c) const;
+		uint64_t        GetLocalSize      (Node node) const;
+		uint64_t        GetRecursiveSize  (Node node) const;
+		uint32_t        GetGraphColor     (Node node) const;
+		CTreeMap::Item* GetItem           (Node node) const;
+
+	private:
+		CFlatTree* _tree;
+	};
+
+	CFlatTree();
+	~CFlatTree();
+
+	void build(CFpgaItem* root);
+	// the node item was copied to, NO_NODE if it isn't under the root
+	uint32_t findNode(const CFpgaItem* item) const;
+
+	void setUtilisationMetric(EUtilisationMetric metric);
+	EUtilisationMetric getUtilisationMetric() const;
+
+	// after either of these call sort() to refresh the visible child counts
+	void recursivelyCalculateSize();
+	void sort();
+
+	uint32_t getNumNodes() const;
+	Item* getItem(uint32_t node);
+
+	uint32_t getParent(uint32_t node) const;
+	uint32_t getNumChildren(uint32_t node) const;
+	// children of non-zero size, sorted largest first
+	uint32_t getNumVisibleChildren(uint32_t node) const;
+	uint32_t getChild(uint32_t node, uint32_t c) const;
+
+	const CStringSpan& getName(uint32_t node) const;
+	uint32_t getLocalSize(uint32_t node) const;
+	uint64_t getRecursiveSize(uint32_t node) const;
+	uint32_t getColour(uint32_t node) const;
+
+private:
+	EUtilisationMetric _metric;
+
+	std::vector<uint32_t> _parents;
+	std::vector<uint32_t> _firstChild;      // offset into _childList
+	std::vector<uint32_t> _numChildren;
+	std::vector<uint32_t> _numVisibleChildren;
+	std::vector<uint32_t> _childList;
+	std::vector<uint32_t> _localSizes[NUM_UTILISATION_METRICS];
+	std::vector<uint64_t> _recursiveSizes;  // for _metric
+	std::vector<uint32_t> _colours;
+	std::vector<CStringSpan> _names;
+	std::vector<const CFpgaItem*> _sources;  // what each node was copied from
+	std::vector<Item> _items;
+};
+
+inline uint32_t CFlatTree::getParent(uint32_t node) const
+{
+	return _parents[node];
+}
+
+inline uint32_t CFlatTree::getNumChildren(uint32_t node) const
+{
+	return _numChildren[node];
+}
+
+inline uint32_t CFlatTree::getNumVisibleChildren(uint32_t node) const
+{
+	return _numVisibleChildren[node];
+}
+
+inline uint32_t CFlatTree::getChild(uint32_t node, uint32_t c) const
+{
+	return _childList[_firstChild[node] + c];
+}
+
+inline uint32_t CFlatTree::getLocalSize(uint32_t node) const
+{
+	return _localSizes[static_cast<uint32_t>(_metric)][node];
+}
+
+inline uint64_t CFlatTree::getRecursiveSize(uint32_t node) const
+{
+	return _recursiveSizes[node];
+}
+
+inline uint32_t CFlatTree::getColour(uint32_t node) const
+{
+	return _colours[node];
+}
+
+inline CFlatTree::Item* CFlatTree::getItem(uint32_t node)
+{
+	return &_items[node];
+}
+
+inline CFlatTree::View::View(CFlatTree* tree) :
+		_tree(tree)
+{
+
+}
+
+inline bool CFlatTree::View::IsLeaf(Node node) const
+{
+	return _tree->getNumVisibleChildren(node) == 0;
+}
+
+inline int CFlatTree::View::GetChildrenCount(Node node) const
+{
+	return _tree->getNumVisibleChildren(node);
+}
+
+inline CFlatTree::View::Node CFlatTree::View::GetChild(Node node, int c) const
+{
+	return _tree->getChild(node, c);
+}
+
+inline uint64_t CFlatTree::View::GetLocalSize(Node node) const
+{
+	return _tree->getLocalSize(node);
+}
+
+inline uint64_t CFlatTree::View::GetRecursiveSize(Node node) const
+{
+	return _tree->getRecursiveSize(node);
+}
+
+inline uint32_t CFlatTree::View::GetGraphColor(Node node) const
+{
+	return _tree->getColour(node);
+}
+
+inline CTreeMap::Item* CFlatTree::View::GetItem(Node node) const
+{
+	return _tree->getItem(node);
+}
+
+#endif /* SRC_CFLATTREE_H_ */
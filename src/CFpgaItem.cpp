@@ -1,55 +1,71 @@
 #include "CFpgaItem.h"
+#include "CFpgaView.h"
 
 #include <cstdint>
 #include <algorithm>
 #include <cinttypes>
 #include <cstring>
 
-EUtilisationMetric CFpgaItem::_UtilisationMetric = EUtilisationMetric::REG;
+thread_local EUtilisationMetric CFpgaItem::_UtilisationMetric = EUtilisationMetric::REG;
 
-CFpgaItem::CFpgaItem(const char* name, const CResourceUtilisation& ru, CFpgaItem* parent) :
+CFpgaItem::CFpgaItem(const CStringSpan& name, const CResourceUtilisation& ru, CFpgaItem* parent) :
+		_children(NULL),
+		_numChildren(0),
+		_childCapacity(0),
 		_ru(ru),
 		_parent(parent),
-		_name(NULL),
-		_sizeofChildren(0),
+		_name(name),
+		_numItems(1),
 		_colour(0x00aa00)
 {
-	uint32_t nameLength = strlen(name);
-	_name = new char[nameLength + 1];
-	memcpy(_name, name, nameLength + 1);
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		_recursiveSizes[m] = ru.get(static_cast<EUtilisationMetric>(m));
+		_sortedChildren[m] = NULL;
+		_numSortedChildren[m] = 0;
+		_sortedIndex[m] = NOT_SORTED;
+		_nextSibling[m] = NULL;
+	}
 }
 
 CFpgaItem::~CFpgaItem()
 {
-	clear();
-	delete[] _name;
+
 }
 
 void CFpgaItem::clear()
 {
-	for (auto itr = _children.begin(); itr != _children.end(); ++itr)
+	// the children themselves are released with the arena
+	_children = NULL;
+	_numChildren = 0;
+	_childCapacity = 0;
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
 	{
-		delete *itr;
+		_recursiveSizes[m] = _ru.get(static_cast<EUtilisationMetric>(m));
+		_sortedChildren[m] = NULL;
+		_numSortedChildren[m] = 0;
 	}
-	_children.clear();
 }
 
 CFpgaItem* CFpgaItem::getChild(int n) const
 {
 	// must return n'th non zero size child
-	uint32_t count = 0;
-	for (auto child : _children)
+	uint32_t metric = getSelectedMetricIndex();
+	if (n < 0 || (uint32_t) n >= _numSortedChildren[metric])
 	{
-		if(child->TmiGetRecursiveSize() > 0)
-		{
-			if(count == n)
-			{
-				return child;
-			}
-			count ++;
-		}
+		return NULL;
 	}
-	return NULL;
+	return _sortedChildren[metric][n];
+}
+
+uint32_t CFpgaItem::getNumChildren() const
+{
+	return _numChildren;
+}
+
+CFpgaItem* CFpgaItem::getChildByIndex(uint32_t index) const
+{
+	return _children[index];
 }
 
 CFpgaItem* CFpgaItem::getParent() const
@@ -57,50 +73,35 @@ CFpgaItem* CFpgaItem::getParent() const
 	return _parent;
 }
 
+CFpgaItem* CFpgaItem::getFirstChild() const
+{
+	return getChild(0);
+}
+
 CFpgaItem* CFpgaItem::getPreviousSibling() const
 {
-	if (_parent)
+	uint32_t metric = getSelectedMetricIndex();
+	uint32_t index = _sortedIndex[metric];
+	if (!_parent || index == NOT_SORTED)
 	{
-		uint32_t numSiblings = _parent->TmiGetChildrenCount();
-		for (uint32_t index = 0; index < numSiblings; index++)
-		{
-			if (_parent->getChild(index) == this)
-			{
-				if (index != 0)
-				{
-					return _parent->getChild(index - 1);
-				}
-				else
-				{
-					return _parent;
-				}
-			}
-		}
+		return NULL;
 	}
-	return NULL;
+	if (index == 0)
+	{
+		return _parent;
+	}
+	return _parent->_sortedChildren[metric][index - 1];
 }
 
 CFpgaItem* CFpgaItem::getNextSibling() const
 {
-	if (_parent)
-	{
-		uint32_t numSiblings = _parent->TmiGetChildrenCount();
-		for (uint32_t index = 0; index < numSiblings; index++)
-		{
-			if (_parent->getChild(index) == this)
-			{
-				if (index != numSiblings - 1)
-				{
-					return _parent->getChild(index + 1);
-				}
-				else
-				{
-					return _parent->getNextSibling();
-				}
-			}
-		}
-	}
-	return NULL;
+	return _nextSibling[getSelectedMetricIndex()];
+}
+
+CFpgaItem* CFpgaItem::getNextInPreorder() const
+{
+	CFpgaItem* child = getFirstChild();
+	return child ? child : getNextSibling();
 }
 
 uint32_t CFpgaItem::getDepth() const
@@ -120,7 +121,7 @@ CResourceUtilisation& CFpgaItem::getResourceUtilisation()
 	return _ru;
 }
 
-const char* CFpgaItem::getName() const
+const CStringSpan& CFpgaItem::getName() const
 {
 	return _name;
 }
@@ -133,7 +134,7 @@ void CFpgaItem::printHeirachy() const
 	{
 		root = root->getParent();
 	}
-	printf("%c %6" PRIu64 " : %-40s\n", root->isAncestorOf(this) ? '-' : '+', root->TmiGetRecursiveSize(), root->getName());
+	printf("%c %6" PRIu64 " : %-40.*s\n", root->isAncestorOf(this) ? '-' : '+', root->TmiGetRecursiveSize(), (int) root->getName().getLength(), root->getName().getData());
 	root->printTreeTo(this);
 }
 
@@ -160,7 +161,7 @@ void CFpgaItem::printTreeTo(const CFpgaItem* descendant) const
 			}
 		}
 		bool isDescendant = descendant->isAncestorOf(child);
-		printf("%c %6" PRIu64 " : %-40s\n", child->TmiIsLeaf() ? ' ' : isDescendant ? '-' : '+', child->TmiGetRecursiveSize(), child->getName());
+		printf("%c %6" PRIu64 " : %-40.*s\n", child->TmiIsLeaf() ? ' ' : isDescendant ? '-' : '+', child->TmiGetRecursiveSize(), (int) child->getName().getLength(), child->getName().getData());
 		if(isDescendant)
 		{
 			child->printTreeTo(descendant);
@@ -168,56 +169,183 @@ void CFpgaItem::printTreeTo(const CFpgaItem* descendant) const
 	}
 }
 
-bool cmp(const CFpgaItem* a, const CFpgaItem* b)
+uint32_t CFpgaItem::prepare(CArena& arena)
 {
-	// rsort
-	return a->TmiGetRecursiveSize() > b->TmiGetRecursiveSize();
+	if (_numChildren && !_sortedChildren[0])
+	{
+		// one block holds the orders of all metrics
+		CFpgaItem** orders = arena.allocateArray<CFpgaItem*>(NUM_UTILISATION_METRICS * _numChildren);
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			_sortedChildren[m] = orders + m * _numChildren;
+		}
+	}
+	_numItems = 1;
+	for (uint32_t c = 0; c < _numChildren; c++)
+	{
+		_numItems += _children[c]->prepare(arena);
+	}
+	return _numItems;
 }
 
 void CFpgaItem::sort()
 {
-	std::sort(_children.begin(), _children.end(), &cmp);
-	for(auto child : _children)
+	sortChildren();
+	for(uint32_t c = 0; c < _numChildren; c++)
 	{
-		child->sort();
+		_children[c]->sort();
 	}
 }
 
-void CFpgaItem::recursivelyCalculateSize()
+void CFpgaItem::sort(CThreadPool& pool)
 {
-	uint64_t childSizes = 0;
-	for (auto child : _children)
+	// our own order first, the children's links depend on it
+	sortChildren();
+	CThreadPool::CTaskGroup group;
+	for (uint32_t c = 0; c < _numChildren; c++)
 	{
-		child->recursivelyCalculateSize();
-		uint64_t childSize = child->TmiGetRecursiveSize();
-		childSizes += childSize;
+		CFpgaItem* child = _children[c];
+		if (child->_numItems >= PARALLEL_SUBTREE_SIZE)
+		{
+			pool.submit(group, [child, &pool]()
+			{
+				child->sort(pool);
+			});
+		}
+	}
+	for (uint32_t c = 0; c < _numChildren; c++)
+	{
+		if (_children[c]->_numItems < PARALLEL_SUBTREE_SIZE)
+		{
+			_children[c]->sort();
+		}
 	}
-	_sizeofChildren = childSizes;
+	pool.wait(group);
 }
 
-void CFpgaItem::setColour(uint32_t colour)
+void CFpgaItem::sortChildren()
 {
-	_colour = colour;
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		CFpgaItem** sorted = _sortedChildren[m];
+		uint32_t count = 0;
+		for (uint32_t c = 0; c < _numChildren; c++)
+		{
+			CFpgaItem* child = _children[c];
+			if (child->_recursiveSizes[m] > 0)
+			{
+				// the position among the children breaks ties until the
+				// sorted one replaces it below
+				child->_sortedIndex[m] = c;
+				sorted[count++] = child;
+			}
+			else
+			{
+				child->_sortedIndex[m] = NOT_SORTED;
+				child->_nextSibling[m] = NULL;
+			}
+		}
+		// rsort, ties keep the order they were added in so they come out
+		// the same on every run. std::stable_sort() would allocate a
+		// buffer for every call.
+		std::sort(sorted, sorted + count, [m](const CFpgaItem* a, const CFpgaItem* b)
+		{
+			return a->_recursiveSizes[m] > b->_recursiveSizes[m] || (a->_recursiveSizes[m] == b->_recursiveSizes[m] && a->_sortedIndex[m] < b->_sortedIndex[m]);
+		});
+		_numSortedChildren[m] = count;
+		// our own links are already set as the parent is sorted first
+		for (uint32_t c = 0; c < count; c++)
+		{
+			sorted[c]->_sortedIndex[m] = c;
+			sorted[c]->_nextSibling[m] = c + 1 < count ? sorted[c + 1] : _nextSibling[m];
+		}
+	}
+}
+
+void CFpgaItem::recursivelyCalculateSize()
+{
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		_recursiveSizes[m] = _ru.get(static_cast<EUtilisationMetric>(m));
+	}
+	for (uint32_t c = 0; c < _numChildren; c++)
+	{
+		CFpgaItem* child = _children[c];
+		child->recursivelyCalculateSize();
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			_recursiveSizes[m] += child->_recursiveSizes[m];
+		}
+	}
 }
 
-void CFpgaItem::addChild(CFpgaItem* child)
+void CFpgaItem::recursivelyCalculateSize(CThreadPool& pool)
 {
-	_children.push_back(child);
+	CThreadPool::CTaskGroup group;
+	for (uint32_t c = 0; c < _numChildren; c++)
+	{
+		CFpgaItem* child = _children[c];
+		if (child->_numItems >= PARALLEL_SUBTREE_SIZE)
+		{
+			pool.submit(group, [child, &pool]()
+			{
+				child->recursivelyCalculateSize(pool);
+			});
+		}
+	}
+	for (uint32_t c = 0; c < _numChildren; c++)
+	{
+		if (_children[c]->_numItems < PARALLEL_SUBTREE_SIZE)
+		{
+			_children[c]->recursivelyCalculateSize();
+		}
+	}
+	pool.wait(group);
+
+	// summed in child order once they are all done, same as sequentially
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		_recursiveSizes[m] = _ru.get(static_cast<EUtilisationMetric>(m));
+	}
+	for (uint32_t c = 0; c < _numChildren; c++)
+	{
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			_recursiveSizes[m] += _children[c]->_recursiveSizes[m];
+		}
+	}
 }
 
-bool CFpgaItem::TmiIsLeaf() const
+void CFpgaItem::setColour(uint32_t colour)
 {
-	return TmiGetChildrenCount() == 0;
+	_colour = colour;
 }
 
-CRect CFpgaItem::TmiGetRectangle() const
+void CFpgaItem::addChild(CFpgaItem* child, CArena& arena)
 {
-	return _rect;
+	if (_numChildren == _childCapacity)
+	{
+		// the old array is simply abandoned in the arena
+		_childCapacity = _childCapacity ? 2 * _childCapacity : 4;
+		CFpgaItem** children = arena.allocateArray<CFpgaItem*>(_childCapacity);
+		std::copy(_children, _children + _numChildren, children);
+		_children = children;
+	}
+	_children[_numChildren++] = child;
+	if (_sortedChildren[0])
+	{
+		// the orders are too short now, prepare() must allocate them again
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			_sortedChildren[m] = NULL;
+			_numSortedChildren[m] = 0;
+		}
+	}
 }
 
-void CFpgaItem::TmiSetRectangle(const CRect& rc)
+bool CFpgaItem::TmiIsLeaf() const
 {
-	_rect = rc;
+	return TmiGetChildrenCount() == 0;
 }
 
 uint32_t CFpgaItem::TmiGetGraphColor() const
@@ -228,15 +356,7 @@ uint32_t CFpgaItem::TmiGetGraphColor() const
 int CFpgaItem::TmiGetChildrenCount() const
 {
 	// must return num non zero size children
-	uint32_t count = 0;
-	for (auto child : _children)
-	{
-		if(child->TmiGetRecursiveSize() > 0)
-		{
-			count ++;
-		}
-	}
-	return count;
+	return _numSortedChildren[getSelectedMetricIndex()];
 }
 
 CTreeMap::Item* CFpgaItem::TmiGetChild(int n) const
@@ -251,7 +371,7 @@ uint64_t CFpgaItem::TmiGetLocalSize() const
 
 uint64_t CFpgaItem::TmiGetRecursiveSize() const
 {
-	return getSelectedMetricSize() + _sizeofChildren;
+	return _recursiveSizes[getSelectedMetricIndex()];
 }
 
 void CFpgaItem::print(FILE* fh)
@@ -263,37 +383,59 @@ void CFpgaItem::print(FILE* fh)
 		fputc('+', fh);
 	}
 
-	fprintf(fh, "%70s, %3u, , %" PRIu64 ", %6u, %6u, %6u, %4u, %4u\n", _name, TmiGetChildrenCount(), TmiGetRecursiveSize(), _ru.getSlices(), _ru.getRegisters(), _ru.getLuts(), _ru.getRams(), _ru.getDsps());
-	for (auto child : _children)
+	fprintf(fh, "%70.*s, %3u, , %" PRIu64 ", %6u, %6u, %6u, %4u, %4u\n", (int) _name.getLength(), _name.getData(), TmiGetChildrenCount(), TmiGetRecursiveSize(), _ru.getSlices(), _ru.getRegisters(), _ru.getLuts(), _ru.getRams(), _ru.getDsps());
+	for (uint32_t c = 0; c < _numChildren; c++)
 	{
-		child->print(fh);
+		_children[c]->print(fh);
 	}
 }
 
-void CFpgaItem::SetUtilisationMetric(EUtilisationMetric metric)
-{
-	_UtilisationMetric = metric;
-}
-
-uint32_t CFpgaItem::getSelectedMetricSize() const
+void CFpgaItem::layoutTreeMap(CTreeMap& treeMap, const CRect& rc, EUtilisationMetric metric, const CTreeMap::Options* options)
 {
-	switch (_UtilisationMetric)
+	switch (metric)
 	{
 		case EUtilisationMetric::SLICE:
-			return _ru.getSlices();
+			treeMap.Layout(rc, CFpgaView<EUtilisationMetric::SLICE>(), this, options);
+			break;
 		case EUtilisationMetric::REG:
-			return _ru.getRegisters();
+			treeMap.Layout(rc, CFpgaView<EUtilisationMetric::REG>(), this, options);
+			break;
 		case EUtilisationMetric::LUT:
-			return _ru.getLuts();
-		case EUtilisationMetric::RAM:
-			return _ru.getRams();
+			treeMap.Layout(rc, CFpgaView<EUtilisationMetric::LUT>(), this, options);
+			break;
 		case EUtilisationMetric::DSP:
-			return _ru.getDsps();
-		default:
-			return 0;
+			treeMap.Layout(rc, CFpgaView<EUtilisationMetric::DSP>(), this, options);
+			break;
+		case EUtilisationMetric::RAM:
+			treeMap.Layout(rc, CFpgaView<EUtilisationMetric::RAM>(), this, options);
+			break;
+	}
+}
+
+void CFpgaItem::drawTreeMap(CTreeMap& treeMap, CFrameBuffer* display, const CRect& rc, EUtilisationMetric metric, const CTreeMap::Options* options)
+{
+	layoutTreeMap(treeMap, rc, metric, options);
+	if (!treeMap.WasCancelled())
+	{
+		treeMap.Render(display);
 	}
 }
 
+void CFpgaItem::SetUtilisationMetric(EUtilisationMetric metric)
+{
+	_UtilisationMetric = metric;
+}
+
+uint32_t CFpgaItem::getSelectedMetricSize() const
+{
+	return _ru.get(_UtilisationMetric);
+}
+
+uint32_t CFpgaItem::getSelectedMetricIndex()
+{
+	return static_cast<uint32_t>(_UtilisationMetric);
+}
+
 bool CFpgaItem::isAncestorOf(const CFpgaItem* other) const
 {
 	const CFpgaItem* item = this;
@@ -5,38 +5,80 @@
 
 #include <cstdint>
 #include <cstdio>
-#include <vector>
 
+#include "CArena.h"
 #include "CResourceUtilisation.h"
+#include "CStringSpan.h"
+#include "CThreadPool.h"
 #include "EUtilisationMetric.h"
-#include "windirstat/CRect.h"
 #include "windirstat/CTreeMap.h"
 
+// Items and their child arrays live in a CArena (see CTreeMapBuilder), they
+// are never deleted individually.
 class CFpgaItem : public CTreeMap::Item
 {
 public:
-	CFpgaItem(const char* name, const CResourceUtilisation& ru, CFpgaItem* parent);
+	// name is not copied, it must outlive the item (see CMrpParser)
+	CFpgaItem(const CStringSpan& name, const CResourceUtilisation& ru, CFpgaItem* parent);
 	virtual ~CFpgaItem();
 
-	void addChild(CFpgaItem* child);
+	// the child array grows inside the arena that owns the items
+	void addChild(CFpgaItem* child, CArena& arena);
 	void clear();
 	CFpgaItem* getChild(int c) const;
+	// all children, including those without any of the selected metric
+	uint32_t getNumChildren() const;
+	CFpgaItem* getChildByIndex(uint32_t index) const;
+	// navigation through the visible children of the selected metric, O(1)
 	CFpgaItem* getParent() const;
+	CFpgaItem* getFirstChild() const;
+	// the parent for the first child
 	CFpgaItem* getPreviousSibling() const;
+	// carries on after the parent for the last child
 	CFpgaItem* getNextSibling() const;
+	CFpgaItem* getNextInPreorder() const;
 	uint32_t getDepth() const;
+	// after changing it run CTreeMapBuilder::finish() to rebuild the orders
 	CResourceUtilisation& getResourceUtilisation();
-	const char* getName() const;
+	const CStringSpan& getName() const;
 	void printHeirachy() const;
 	void printTreeTo(const CFpgaItem* descendant) const;
-	void sort();
+	// allocates the sorted orders in the arena and counts the items of every
+	// subtree, returning the total. Must run before sort() and before both
+	// pool versions.
+	uint32_t prepare(CArena& arena);
+	// sums every metric at once, then sort() builds the non-zero child order
+	// of each metric, so switching metric needs neither again. Ties keep the
+	// order the children were added in.
 	void recursivelyCalculateSize();
+	void sort();
+	// the same, forking onto the pool for subtrees of PARALLEL_SUBTREE_SIZE
+	// items or more, with results identical to the sequential versions
+	void recursivelyCalculateSize(CThreadPool& pool);
+	void sort(CThreadPool& pool);
+	uint32_t getColour() const;
 	void setColour(uint32_t colour);
 
+	// The queries of the interface functions for a metric fixed at
+	// compile time, plain array reads, see CFpgaView
+	template <EUtilisationMetric METRIC> uint32_t getNumVisibleChildren() const;
+	template <EUtilisationMetric METRIC> CFpgaItem* getVisibleChild(uint32_t c) const;
+	template <EUtilisationMetric METRIC> uint32_t getLocalSize() const;
+	template <EUtilisationMetric METRIC> uint64_t getRecursiveSize() const;
+	// the same for a metric chosen at run time, see CSnapshot
+	uint32_t getNumVisibleChildren(EUtilisationMetric metric) const;
+	uint64_t getRecursiveSize(EUtilisationMetric metric) const;
+	// where sort() put this item among its parent's visible children of
+	// metric, NOT_SORTED if it has none of it
+	uint32_t getSortedIndex(EUtilisationMetric metric) const;
+
+	// Lays out or draws this subtree through the CFpgaView of metric,
+	// whatever the calling thread's metric is
+	void layoutTreeMap(CTreeMap& treeMap, const CRect& rc, EUtilisationMetric metric, const CTreeMap::Options* options);
+	void drawTreeMap(CTreeMap& treeMap, CFrameBuffer* display, const CRect& rc, EUtilisationMetric metric, const CTreeMap::Options* options);
+
 	// interface functions
 	bool            TmiIsLeaf          () const;
-	CRect           TmiGetRectangle    () const;
-	void            TmiSetRectangle    (const CRect& rc);
 	uint32_t        TmiGetGraphColor   () const;
 	int             TmiGetChildrenCount() const;
 	CTreeMap::Item* TmiGetChild        (int c) const;
@@ -45,23 +87,85 @@ public:
 
 	void print(FILE* fh);
 
+	// what the interface functions and the navigation use, for the
+	// calling thread only
 	static void SetUtilisationMetric(EUtilisationMetric metric);
 
+	static const uint32_t PARALLEL_SUBTREE_SIZE = 1 << 14;
+	static const uint32_t NOT_SORTED = 0xffffffff;
+
 private:
 	uint32_t        getSelectedMetricSize() const;
+	static uint32_t getSelectedMetricIndex();
+	void            sortChildren();
 	bool            isAncestorOf(const CFpgaItem* other) const;
 
-	CRect _rect;
-	std::vector<CFpgaItem*> _children;
+	CFpgaItem** _children;
+	uint32_t _numChildren;
+	uint32_t _childCapacity;
 	CResourceUtilisation _ru;
 	CFpgaItem* _parent;
-	char* _name;
-	uint64_t _sizeofChildren;;
+	CStringSpan _name;
+	uint32_t _numItems;
+	uint64_t _recursiveSizes[NUM_UTILISATION_METRICS];
+	// children with a non-zero recursive size, largest first
+	CFpgaItem** _sortedChildren[NUM_UTILISATION_METRICS];
+	uint32_t _numSortedChildren[NUM_UTILISATION_METRICS];
+	// where sort() put this item in its parent's orders
+	uint32_t _sortedIndex[NUM_UTILISATION_METRICS];
+	CFpgaItem* _nextSibling[NUM_UTILISATION_METRICS];
+
 	uint32_t _colour;
 
-	static EUtilisationMetric _UtilisationMetric;
+	// per thread, so treemaps of different metrics can be drawn side by
+	// side through the interface functions too
+	static thread_local EUtilisationMetric _UtilisationMetric;
 
 
 };
 
+inline uint32_t CFpgaItem::getColour() const
+{
+	return _colour;
+}
+
+template <EUtilisationMetric METRIC>
+inline uint32_t CFpgaItem::getNumVisibleChildren() const
+{
+	return _numSortedChildren[static_cast<uint32_t>(METRIC)];
+}
+
+template <EUtilisationMetric METRIC>
+inline CFpgaItem* CFpgaItem::getVisibleChild(uint32_t c) const
+{
+	return _sortedChildren[static_cast<uint32_t>(METRIC)][c];
+}
+
+template <EUtilisationMetric METRIC>
+inline uint32_t CFpgaItem::getLocalSize() const
+{
+	return _ru.get<METRIC>();
+}
+
+template <EUtilisationMetric METRIC>
+inline uint64_t CFpgaItem::getRecursiveSize() const
+{
+	return _recursiveSizes[static_cast<uint32_t>(METRIC)];
+}
+
+inline uint32_t CFpgaItem::getNumVisibleChildren(EUtilisationMetric metric) const
+{
+	return _numSortedChildren[static_cast<uint32_t>(metric)];
+}
+
+inline uint64_t CFpgaItem::getRecursiveSize(EUtilisationMetric metric) const
+{
+	return _recursiveSizes[static_cast<uint32_t>(metric)];
+}
+
+inline uint32_t CFpgaItem::getSortedIndex(EUtilisationMetric metric) const
+{
+	return _sortedIndex[static_cast<uint32_t>(metric)];
+}
+
 #endif /* SRC_CFPGAITEM_H_ */
@@ -0,0 +1,69 @@
+#ifndef SRC_CFPGAVIEW_H_
+#define SRC_CFPGAVIEW_H_
+
+#include "CFpgaItem.h"
+#include "EUtilisationMetric.h"
+#include "windirstat/CTreeMap.h"
+
+// How CTreeMap's layout sees a CFpgaItem tree sized by METRIC (see
+// CTreeMap::ItemView). Every query is an inlined read of the item's
+// array for METRIC, so any number of views of one tree can be laid out
+// at once and none of them touches the per-thread metric.
+template <EUtilisationMetric METRIC>
+class CFpgaView
+{
+public:
+	typedef CFpgaItem* Node;
+
+	bool            IsLeaf            (Node item) const;
+	int             GetChildrenCount  (Node item) const;
+	Node            GetChild          (Node item, int c) const;
+	uint64_t        GetLocalSize      (Node item) const;
+	uint64_t        GetRecursiveSize  (Node item) const;
+	uint32_t        GetGraphColor     (Node item) const;
+	CTreeMap::Item* GetItem           (Node item) const;
+};
+
+template <EUtilisationMetric METRIC>
+inline bool CFpgaView<METRIC>::IsLeaf(Node item) const
+{
+	return item->getNumVisibleChildren<METRIC>() == 0;
+}
+
+template <EUtilisationMetric METRIC>
+inline int CFpgaView<METRIC>::GetChildrenCount(Node item) const
+{
+	return item->getNumVisibleChildren<METRIC>();
+}
+
+template <EUtilisationMetric METRIC>
+inline typename CFpgaView<METRIC>::Node CFpgaView<METRIC>::GetChild(Node item, int c) const
+{
+	return item->getVisibleChild<METRIC>(c);
+}
+
+template <EUtilisationMetric METRIC>
+inline uint64_t CFpgaView<METRIC>::GetLocalSize(Node item) const
+{
+	return item->getLocalSize<METRIC>();
+}
+
+template <EUtilisationMetric METRIC>
+inline uint64_t CFpgaView<METRIC>::GetRecursiveSize(Node item) const
+{
+	return item->getRecursiveSize<METRIC>();
+}
+
+template <EUtilisationMetric METRIC>
+inline uint32_t CFpgaView<METRIC>::GetGraphColor(Node item) const
+{
+	return item->getColour();
+}
+
+template <EUtilisationMetric METRIC>
+inline CTreeMap::Item* CFpgaView<METRIC>::GetItem(Node item) const
+{
+	return item;
+}
+
+#endif /* SRC_CFPGAVIEW_H_ */
@@ -0,0 +1,141 @@
+#include "CFrameBuffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "windirstat/CRect.h"
+
+CFrameBuffer::CFrameBuffer(uint32_t width, uint32_t height) :
+		_pixels(new uint32_t[width * height]()),
+		_ownsPixels(true),
+		_width(width),
+		_height(height),
+		_pitch(width)
+{
+
+}
+
+CFrameBuffer::CFrameBuffer(uint32_t* pixels, uint32_t width, uint32_t height, uint32_t pitch) :
+		_pixels(pixels),
+		_ownsPixels(false),
+		_width(width),
+		_height(height),
+		_pitch(pitch)
+{
+
+}
+
+CFrameBuffer::~CFrameBuffer()
+{
+	if (_ownsPixels)
+	{
+		delete[] _pixels;
+	}
+}
+
+uint32_t CFrameBuffer::getWidth() const
+{
+	return _width;
+}
+
+uint32_t CFrameBuffer::getHeight() const
+{
+	return _height;
+}
+
+uint32_t CFrameBuffer::getPitch() const
+{
+	return _pitch;
+}
+
+void CFrameBuffer::setPixel(int32_t x, int32_t y, uint32_t pixel)
+{
+	_pixels[y * _pitch + x] = pixel;
+}
+
+uint32_t CFrameBuffer::setColour(uint8_t r, uint8_t g, uint8_t b)
+{
+	uint32_t pixel = b + (g << 8) + (r << 16);
+	return pixel;
+}
+
+void CFrameBuffer::fillSolidRect(const CRect& rect, uint32_t colour)
+{
+	if (rect.getRight() <= rect.getLeft())
+	{
+		return;
+	}
+	for (uint32_t y = rect.getTop(); y < rect.getBottom(); y++)
+	{
+		uint32_t* row = _pixels + y * _pitch;
+		std::fill(row + rect.getLeft(), row + rect.getRight(), colour);
+	}
+}
+
+void CFrameBuffer::drawRectEdge(const CRect& rect, uint32_t colour)
+{
+	drawStraightLine(rect.getLeft(), rect.getTop(), rect.getRight(), rect.getTop(), colour);
+	drawStraightLine(rect.getLeft(), rect.getBottom(), rect.getRight(), rect.getBottom(), colour);
+	drawStraightLine(rect.getLeft(), rect.getTop(), rect.getLeft(), rect.getBottom(), colour);
+	drawStraightLine(rect.getRight(), rect.getTop(), rect.getRight(), rect.getBottom(), colour);
+}
+
+void CFrameBuffer::drawStraightLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel)
+{
+	if (y1 > y2)
+	{
+		int temp = y2;
+		y2 = y1;
+		y1 = temp;
+	}
+	if (x1 > x2)
+	{
+		int temp = x2;
+		x2 = x1;
+		x1 = temp;
+	}
+	if (x1 == x2)
+	{
+		for (int y = y1; y < y2 + 1; y++)
+		{
+			setPixel(x1, y, pixel);
+		}
+	}
+	else
+	{
+		for (int x = x1; x < x2; x++)
+		{
+			setPixel(x, y1, pixel);
+		}
+	}
+}
+
+void CFrameBuffer::drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel)
+{
+	int32_t dx = std::abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+	int32_t dy = std::abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+	int32_t err = (dx > dy ? dx : -dy) / 2, e2;
+
+	for (;;)
+	{
+		setPixel(x1, y1, pixel);
+		if (x1 == x2 && y1 == y2)
+			break;
+		e2 = err;
+		if (e2 > -dx)
+		{
+			err -= dy;
+			x1 += sx;
+		}
+		if (e2 < dy)
+		{
+			err += dx;
+			y1 += sy;
+		}
+	}
+}
+
+uint32_t* CFrameBuffer::getScreen() const
+{
+	return _pixels;
+}
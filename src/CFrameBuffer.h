@@ -0,0 +1,44 @@
+#ifndef SRC_CFRAMEBUFFER_H_
+#define SRC_CFRAMEBUFFER_H_
+
+#include <cstdint>
+
+class CRect;
+
+// 32 bit pixels the treemap is drawn on, blue in the lowest byte. Either
+// owns its pixels or draws on memory owned by someone else, such as the
+// SDL screen.
+class CFrameBuffer
+{
+public:
+	CFrameBuffer(uint32_t width, uint32_t height);
+	// pitch is in pixels
+	CFrameBuffer(uint32_t* pixels, uint32_t width, uint32_t height, uint32_t pitch);
+	~CFrameBuffer();
+
+	uint32_t    getWidth             () const;
+	uint32_t    getHeight            () const;
+	uint32_t    getPitch             () const;
+
+	void        setPixel             (int32_t x, int32_t y, uint32_t pixel);
+	void        drawStraightLine     (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel);
+	void        drawLine             (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel);
+	uint32_t    setColour            (uint8_t r, uint8_t g, uint8_t b);
+
+	void        fillSolidRect        (const CRect& rect, uint32_t colour);
+	void        drawRectEdge         (const CRect& rect, uint32_t colour);
+
+	uint32_t*   getScreen            () const;
+
+private:
+	CFrameBuffer(const CFrameBuffer&) = delete;
+	CFrameBuffer& operator=(const CFrameBuffer&) = delete;
+
+	uint32_t* _pixels;
+	bool _ownsPixels;
+	uint32_t _width;
+	uint32_t _height;
+	uint32_t _pitch;
+};
+
+#endif /* SRC_CFRAMEBUFFER_H_ */
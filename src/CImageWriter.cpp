@@ -0,0 +1,171 @@
+#include "CImageWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+#include "CFrameBuffer.h"
+
+bool CImageWriter::write(const char* filename, const CFrameBuffer& frameBuffer)
+{
+	const size_t length = strlen(filename);
+	if (length >= 4 && strcasecmp(filename + length - 4, ".png") == 0)
+	{
+		return writePng(filename, frameBuffer);
+	}
+	return writePpm(filename, frameBuffer);
+}
+
+bool CImageWriter::writePpm(const char* filename, const CFrameBuffer& frameBuffer)
+{
+	const uint32_t width = frameBuffer.getWidth();
+	const uint32_t height = frameBuffer.getHeight();
+	const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+
+	std::vector<uint8_t> ppm(header.begin(), header.end());
+	ppm.resize(header.size() + (uint64_t) width * height * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		getRgbRow(frameBuffer, y, &ppm[header.size() + (uint64_t) y * width * 3]);
+	}
+	return writeFile(filename, ppm.data(), ppm.size());
+}
+
+bool CImageWriter::writePng(const char* filename, const CFrameBuffer& frameBuffer)
+{
+	static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	const uint32_t width = frameBuffer.getWidth();
+	const uint32_t height = frameBuffer.getHeight();
+
+	// Every row starts with filter type 0, none
+	const uint32_t rowLength = 1 + width * 3;
+	std::vector<uint8_t> raw((uint64_t) rowLength * height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		raw[(uint64_t) y * rowLength] = 0;
+		getRgbRow(frameBuffer, y, &raw[(uint64_t) y * rowLength + 1]);
+	}
+
+	// zlib stream of stored blocks: no compression, no window
+	std::vector<uint8_t> zlib = { 0x78, 0x01 };
+	zlib.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+	uint64_t offset = 0;
+	do
+	{
+		const uint32_t length = std::min<uint64_t>(raw.size() - offset, MAX_STORED_BLOCK);
+		const bool final = offset + length == raw.size();
+		const uint8_t header[5] = { final, (uint8_t) length, (uint8_t) (length >> 8), (uint8_t) ~length, (uint8_t) (~length >> 8) };
+		zlib.insert(zlib.end(), header, header + sizeof(header));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+
+	// Adler-32, reduced before the sums can overflow
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (uint64_t i = 0; i < raw.size();)
+	{
+		const uint64_t end = std::min<uint64_t>(raw.size(), i + 5552);
+		for (; i < end; i++)
+		{
+			a += raw[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	appendBigEndian(zlib, (b << 16) | a);
+
+	std::vector<uint8_t> ihdr;
+	appendBigEndian(ihdr, width);
+	appendBigEndian(ihdr, height);
+	// 8 bit RGB, deflate, adaptive filtering, not interlaced
+	const uint8_t format[5] = { 8, 2, 0, 0, 0 };
+	ihdr.insert(ihdr.end(), format, format + sizeof(format));
+
+	std::vector<uint8_t> png(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+	png.reserve(zlib.size() + 64);
+	appendChunk(png, "IHDR", ihdr.data(), ihdr.size());
+	appendChunk(png, "IDAT", zlib.data(), zlib.size());
+	appendChunk(png, "IEND", NULL, 0);
+	return writeFile(filename, png.data(), png.size());
+}
+
+void CImageWriter::getRgbRow(const CFrameBuffer& frameBuffer, uint32_t y, uint8_t* rgb)
+{
+	const uint32_t* pixel = frameBuffer.getScreen() + (uint64_t) y * frameBuffer.getPitch();
+	for (uint32_t x = 0; x < frameBuffer.getWidth(); x++)
+	{
+		*rgb++ = pixel[x] >> 16;
+		*rgb++ = pixel[x] >> 8;
+		*rgb++ = pixel[x];
+	}
+}
+
+void CImageWriter::appendChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, uint32_t length)
+{
+	appendBigEndian(png, length);
+	const uint64_t start = png.size();
+	png.insert(png.end(), type, type + 4);
+	if (length)
+	{
+		png.insert(png.end(), data, data + length);
+	}
+	// over the type and the data
+	appendBigEndian(png, crc32(0, &png[start], png.size() - start));
+}
+
+void CImageWriter::appendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	const uint8_t bytes[4] = { (uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value };
+	out.insert(out.end(), bytes, bytes + sizeof(bytes));
+}
+
+uint32_t CImageWriter::crc32(uint32_t crc, const uint8_t* data, uint32_t length)
+{
+	// built once, even with several threads writing images
+	static const std::vector<uint32_t> table = makeCrcTable();
+
+	crc = ~crc;
+	for (uint32_t i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+std::vector<uint32_t> CImageWriter::makeCrcTable()
+{
+	std::vector<uint32_t> table(256);
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+		for (uint32_t k = 0; k < 8; k++)
+		{
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		}
+		table[n] = c;
+	}
+	return table;
+}
+
+bool CImageWriter::writeFile(const char* filename, const uint8_t* data, uint64_t length)
+{
+	FILE* fh = fopen(filename, "wb");
+	if (!fh)
+	{
+		fprintf(stderr, "Unable to write image %s: %s\n", filename, strerror(errno));
+		return false;
+	}
+	const bool written = fwrite(data, 1, length, fh) == length;
+	if (fclose(fh) != 0 || !written)
+	{
+		fprintf(stderr, "Unable to write image %s: %s\n", filename, strerror(errno));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SRC_CIMAGEWRITER_H_
+#define SRC_CIMAGEWRITER_H_
+
+#include <cstdint>
+#include <vector>
+
+class CFrameBuffer;
+
+// Saves a frame buffer as a binary PPM or as a PNG. The PNG is written
+// with stored (uncompressed) deflate blocks, so neither needs a library.
+class CImageWriter
+{
+public:
+	// picks the format from the extension, PNG for ".png", otherwise PPM
+	static bool write(const char* filename, const CFrameBuffer& frameBuffer);
+	static bool writePpm(const char* filename, const CFrameBuffer& frameBuffer);
+	static bool writePng(const char* filename, const CFrameBuffer& frameBuffer);
+
+private:
+	static const uint32_t MAX_STORED_BLOCK = 65535;
+
+	static void getRgbRow(const CFrameBuffer& frameBuffer, uint32_t y, uint8_t* rgb);
+	static void appendChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, uint32_t length);
+	static void appendBigEndian(std::vector<uint8_t>& out, uint32_t value);
+	static uint32_t crc32(uint32_t crc, const uint8_t* data, uint32_t length);
+	static std::vector<uint32_t> makeCrcTable();
+	static bool writeFile(const char* filename, const uint8_t* data, uint64_t length);
+};
+
+#endif /* SRC_CIMAGEWRITER_H_ */
@@ -0,0 +1,113 @@
+#include "CLayoutBenchmark.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "CFpgaItem.h"
+#include "CFrameBuffer.h"
+#include "CResourceUtilisation.h"
+#include "windirstat/CRect.h"
+
+static const uint32_t SEED = 12345;
+static const uint32_t COLOURS[] = { 0x00aa00, 0xaa0000, 0x0000aa, 0xaaaa00, 0x00aaaa, 0xaa00aa };
+
+CLayoutBenchmark::CLayoutBenchmark(uint32_t numItems, uint32_t width, uint32_t height) :
+		_root(NULL),
+		_width(width),
+		_height(height)
+{
+	generate(numItems);
+}
+
+CLayoutBenchmark::~CLayoutBenchmark()
+{
+
+}
+
+void CLayoutBenchmark::generate(uint32_t numItems)
+{
+	std::mt19937 random(SEED);
+	std::vector<CFpgaItem*> items;
+	items.reserve(numItems);
+	_builder.reserve(numItems);
+
+	// Each item hangs off one picked uniformly from those before it, which
+	// gives a few wide levels near the root and about half the items as
+	// leaves. Sizes are skewed so most rectangles are small. The layout
+	// never looks at names, so they are all the same.
+	for (uint32_t i = 0; i < numItems; i++)
+	{
+		CResourceUtilisation ru;
+		const uint32_t size = random() % 64;
+		ru.getRegisters() = size * size;
+		ru.getLuts() = random() % 4096;
+		ru.getSlices() = random() % 1024;
+		ru.getDsps() = random() % 16 == 0;
+		ru.getRams() = random() % 32 == 0;
+
+		CFpgaItem* parent = i ? items[random() % i] : NULL;
+		CFpgaItem* item = _builder.createItem("item", ru, parent);
+		item->setColour(COLOURS[random() % (sizeof(COLOURS) / sizeof(COLOURS[0]))]);
+		items.push_back(item);
+	}
+
+	_root = items[0];
+	_builder.setItems(_root);
+	_builder.finish();
+
+	_flatTree.build(_root);
+	_flatTree.setUtilisationMetric(EUtilisationMetric::REG);
+	_flatTree.recursivelyCalculateSize();
+	_flatTree.sort();
+}
+
+template <typename LAYOUT>
+double CLayoutBenchmark::time(uint32_t repetitions, LAYOUT layout)
+{
+	// once to warm the caches
+	layout();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t r = 0; r < repetitions; r++)
+	{
+		layout();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repetitions;
+}
+
+void CLayoutBenchmark::run(uint32_t repetitions)
+{
+	const CRect rc(0, 0, _width, _height);
+	CFpgaItem* root = _root;
+	CFlatTree* flatTree = &_flatTree;
+	CTreeMap* treeMap = &_treeMap;
+
+	printf("%u items, %u x %u, REG, mean of %u layouts\n", _flatTree.getNumNodes(), _width, _height, repetitions);
+
+	const CTreeMap::STYLE styles[] = { CTreeMap::SequoiaViewStyle, CTreeMap::KDirStatStyle };
+	for (CTreeMap::STYLE style : styles)
+	{
+		CTreeMap::Options options = CTreeMap::GetDefaultOptions();
+		options.style = style;
+		const CTreeMap::Options* opts = &options;
+
+		CFpgaItem::SetUtilisationMetric(EUtilisationMetric::REG);
+		const double fpgaItem = time(repetitions, [=] { treeMap->Layout(rc, root, opts); });
+		const double fpgaView = time(repetitions, [=] { root->layoutTreeMap(*treeMap, rc, EUtilisationMetric::REG, opts); });
+		const double flatItem = time(repetitions, [=] { treeMap->Layout(rc, flatTree->getItem(0), opts); });
+		const double flatView = time(repetitions, [=] { treeMap->Layout(rc, CFlatTree::View(flatTree), 0, opts); });
+
+		// Render() only reads the layout, it is the same whichever view made it
+		CFrameBuffer frameBuffer(_width, _height);
+		const double render = time(repetitions, [=, &frameBuffer] { treeMap->Render(&frameBuffer); });
+
+		printf("%s: %zu rectangles\n", style == CTreeMap::KDirStatStyle ? "KDirStat" : "SequoiaView", _treeMap.GetLayout().size());
+		printf("  CFpgaItem       %8.2f ms\n", fpgaItem);
+		printf("  CFpgaView       %8.2f ms  %.2fx\n", fpgaView, fpgaItem / fpgaView);
+		printf("  CFlatTree::Item %8.2f ms\n", flatItem);
+		printf("  CFlatTree::View %8.2f ms  %.2fx\n", flatView, flatItem / flatView);
+		printf("  Render          %8.2f ms\n", render);
+	}
+}
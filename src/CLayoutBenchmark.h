@@ -0,0 +1,37 @@
+#ifndef SRC_CLAYOUTBENCHMARK_H_
+#define SRC_CLAYOUTBENCHMARK_H_
+
+#include <cstdint>
+
+#include "CFlatTree.h"
+#include "CTreeMapBuilder.h"
+#include "windirstat/CTreeMap.h"
+
+class CFpgaItem;
+
+// Times CTreeMap::Layout() on a random tree through the virtual Item
+// interface and through the views the layout is instantiated for, CFpgaView
+// and CFlatTree::View. The tree comes from a fixed seed, so runs compare.
+class CLayoutBenchmark
+{
+public:
+	CLayoutBenchmark(uint32_t numItems, uint32_t width, uint32_t height);
+	~CLayoutBenchmark();
+
+	void run(uint32_t repetitions);
+
+private:
+	void generate(uint32_t numItems);
+	// milliseconds per layout, the layout itself is left in _treeMap
+	template <typename LAYOUT>
+	double time(uint32_t repetitions, LAYOUT layout);
+
+	CTreeMapBuilder _builder;
+	CFpgaItem* _root;
+	CFlatTree _flatTree;
+	CTreeMap _treeMap;
+	uint32_t _width;
+	uint32_t _height;
+};
+
+#endif /* SRC_CLAYOUTBENCHMARK_H_ */
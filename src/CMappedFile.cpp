@@ -0,0 +1,86 @@
+#include "CMappedFile.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CMappedFile::CMappedFile() :
+		_fd(-1),
+		_data(NULL),
+		_size(0)
+{
+
+}
+
+CMappedFile::~CMappedFile()
+{
+	close();
+}
+
+bool CMappedFile::open(const char* filename)
+{
+	close();
+
+	_fd = ::open(filename, O_RDONLY);
+	if (_fd < 0)
+	{
+		fprintf(stderr, "%s::%s error opening %s: %s\n", __FILE__, __FUNCTION__, filename, strerror(errno));
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(_fd, &st) != 0)
+	{
+		fprintf(stderr, "%s::%s error reading size of %s: %s\n", __FILE__, __FUNCTION__, filename, strerror(errno));
+		close();
+		return false;
+	}
+	_size = st.st_size;
+
+	if (_size == 0)
+	{
+		// mmap() refuses zero length mappings
+		return true;
+	}
+
+	_data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (_data == MAP_FAILED)
+	{
+		fprintf(stderr, "%s::%s error mapping %s: %s\n", __FILE__, __FUNCTION__, filename, strerror(errno));
+		_data = NULL;
+		close();
+		return false;
+	}
+	madvise(_data, _size, MADV_SEQUENTIAL);
+
+	return true;
+}
+
+void CMappedFile::close()
+{
+	if (_data)
+	{
+		munmap(_data, _size);
+		_data = NULL;
+	}
+	if (_fd >= 0)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+	_size = 0;
+}
+
+const char* CMappedFile::getData() const
+{
+	return _data ? static_cast<const char*>(_data) : "";
+}
+
+uint64_t CMappedFile::getSize() const
+{
+	return _size;
+}
@@ -0,0 +1,29 @@
+#ifndef SRC_CMAPPEDFILE_H_
+#define SRC_CMAPPEDFILE_H_
+
+#include <cstdint>
+
+// Read-only memory mapping of a whole file. Anything pointing into getData()
+// is only valid for as long as the CMappedFile stays open.
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	bool open(const char* filename);
+	void close();
+
+	const char* getData() const;
+	uint64_t getSize() const;
+
+private:
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	int _fd;
+	void* _data;
+	uint64_t _size;
+};
+
+#endif /* SRC_CMAPPEDFILE_H_ */
@@ -1,9 +1,13 @@
 #include "CMrpParser.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <thread>
 
 #include "CFpgaItem.h"
+#include "CRowTokeniser.h"
+#include "CThreadPool.h"
 #include "CTreeMapBuilder.h"
 
 CMrpParser::CMrpParser(const char* mapReport) :
@@ -11,12 +15,21 @@ CMrpParser::CMrpParser(const char* mapReport) :
 		_items(NULL),
 		_treeMapBuilder(NULL)
 {
-
+	_designSummaryMatcher.addKey("Slice LUTs",                SLICE_LUTS);
+	_designSummaryMatcher.addKey("Slice Registers",           SLICE_REGISTERS);
+	_designSummaryMatcher.addKey("occupied Slices",           OCCUPIED_SLICES);
+	_designSummaryMatcher.addKey("DSP48E1s",                  DSP48E1S);
+	_designSummaryMatcher.addKey("DSP48A1s",                  DSP48A1S);
+	_designSummaryMatcher.addKey("RAMB8BWERs",                RAMB8BWERS);
+	_designSummaryMatcher.addKey("RAMB16BWERs",               RAMB16BWERS);
+	_designSummaryMatcher.addKey("RAMB18E1/FIFO18E1s",        RAMB18E1S);
+	_designSummaryMatcher.addKey("RAMB36E1/FIFO36E1s",        RAMB36E1S);
 }
 
 CMrpParser::~CMrpParser()
 {
-
+	// releases the items
+	delete _treeMapBuilder;
 }
 
 CFpgaItem* CMrpParser::getItems() const
@@ -24,10 +37,19 @@ CFpgaItem* CMrpParser::getItems() const
 	return _items;
 }
 
+const CResourceUtilisation& CMrpParser::getUsed() const
+{
+	return _used;
+}
+
+const CResourceUtilisation& CMrpParser::getTotal() const
+{
+	return _total;
+}
+
 bool CMrpParser::parse()
 {
-	FILE* fh = fopen(_mapReport, "r");
-	if (!fh)
+	if (!_report.open(_mapReport))
 	{
 		fprintf(stderr, "%s::%s error opening map report: %s\n", __FILE__, __FUNCTION__, _mapReport);
 		return false;
@@ -40,22 +62,24 @@ bool CMrpParser::parse()
 
 	ESection section = ESection::NONE;
 
-	char* line = NULL;
-	size_t bufferSize = 0;
-	int32_t lineLength = 0;
+	const char* data = _report.getData();
+	const char* end = data + _report.getSize();
 
-	uint32_t usedDspA1s = 0, usedDspE1s = 0, totalDspA1s = 0, totalDspE1s = 0;
-	uint32_t usedRam8s = 0, usedRam16s = 0, usedRam18s = 0, usedRam36s = 0;
-	uint32_t totalRam8s = 0, totalRam16s = 0, totalRam18s = 0, totalRam36s = 0;
-	bool headerRowSeen = false;
+	uint32_t used[NUM_DESIGN_SUMMARY_VALUES] = { 0 };
+	uint32_t total[NUM_DESIGN_SUMMARY_VALUES] = { 0 };
 
-	while ((lineLength = getline(&line, &bufferSize, fh)) != -1)
+	while (data < end && section != ESection::UTILISATION_BY_HEIRACHY)
 	{
+		// lines are spans into the mapping, without the trailing newline
+		const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+		CStringSpan line(data, (newline ? newline : end) - data);
+		data = newline ? newline + 1 : end;
+
 		switch (section)
 		{
 			case ESection::NONE:
 			{
-				if(strcmp(line, "Design Summary\n") == 0)
+				if(line.equals("Design Summary"))
 				{
 					section = ESection::DESIGN_SUMMARY;
 				}
@@ -63,48 +87,46 @@ bool CMrpParser::parse()
 			}
 			case ESection::DESIGN_SUMMARY:
 			{
-				extractDesignSummaryValues(line, "  Number of Slice LUTs:  ",      _used.getLuts(),      _total.getLuts());
-				extractDesignSummaryValues(line, "  Number of Slice Registers:  ", _used.getRegisters(), _total.getRegisters());
-				extractDesignSummaryValues(line, "  Number of occupied Slices:  ", _used.getSlices(),    _total.getSlices());
-				extractDesignSummaryValues(line, "  Number of DSP48E1s:  ", usedDspE1s, totalDspE1s);
-				extractDesignSummaryValues(line, "  Number of DSP48A1s:  ", usedDspA1s, totalDspA1s);
-				extractDesignSummaryValues(line, "  Number of RAMB8BWERs:  ", usedRam8s, totalRam8s);
-				extractDesignSummaryValues(line, "  Number of RAMB16BWERs:  ", usedRam16s, totalRam16s);
-				extractDesignSummaryValues(line, "  Number of RAMB18E1/FIFO18E1s:  ", usedRam18s, totalRam18s);
-				extractDesignSummaryValues(line, "  Number of RAMB36E1/FIFO36E1s:  ", usedRam36s, totalRam36s);
-
-				if(strcmp(line, "Table of Contents\n") == 0)
+				CStringSpan values;
+				int32_t value = _designSummaryMatcher.match(line, values);
+				if(value >= 0)
+				{
+					CDesignSummaryMatcher::parseUsedAndTotal(values, used[value], total[value]);
+				}
+
+				if(line.equals("Table of Contents"))
 				{
 					section = ESection::TABLE_OF_CONTENTS;
 
-					_used.getDsps() = usedDspE1s + usedDspA1s;
-					_total.getDsps() = totalDspE1s + totalDspA1s;
-					if (totalRam8s != 0)
+					_used.getLuts() = used[SLICE_LUTS];
+					_total.getLuts() = total[SLICE_LUTS];
+					_used.getRegisters() = used[SLICE_REGISTERS];
+					_total.getRegisters() = total[SLICE_REGISTERS];
+					_used.getSlices() = used[OCCUPIED_SLICES];
+					_total.getSlices() = total[OCCUPIED_SLICES];
+					_used.getDsps() = used[DSP48E1S] + used[DSP48A1S];
+					_total.getDsps() = total[DSP48E1S] + total[DSP48A1S];
+					if (total[RAMB8BWERS] != 0)
 					{
-						_used.getRams() = usedRam8s + 2 * usedRam16s;
-						_total.getRams() = totalRam8s;
+						_used.getRams() = used[RAMB8BWERS] + 2 * used[RAMB16BWERS];
+						_total.getRams() = total[RAMB8BWERS];
 					}
-					else if (totalRam18s != 0)
+					else if (total[RAMB18E1S] != 0)
 					{
-						_used.getRams() = usedRam18s + 2 * usedRam36s;
-						_total.getRams() = totalRam18s;
+						_used.getRams() = used[RAMB18E1S] + 2 * used[RAMB36E1S];
+						_total.getRams() = total[RAMB18E1S];
 					}
 
-					printf("Slices      : %6u / %6u (%2.1f%%)\n", _used.getSlices(), _total.getSlices(), 100.0f * _used.getSlices() / (float) (std::max(1U, _total.getSlices())));
-					printf("  Luts      : %6u / %6u (%2.1f%%)\n", _used.getLuts(), _total.getLuts(), 100.0f * _used.getLuts() / (float) (std::max(1U, _total.getLuts())));
-					printf("  Registers : %6u / %6u (%2.1f%%)\n", _used.getRegisters(), _total.getRegisters(), 100.0f * _used.getRegisters() / (float) (std::max(1U, _total.getRegisters())));
-					printf("RAMs        : %6u / %6u (%2.1f%%)\n", _used.getRams(), _total.getRams(), 100.0f * _used.getRams() / (float) (std::max(1U, _total.getRams())));
-					printf("DSPs        : %6u / %6u (%2.1f%%)\n", _used.getDsps(), _total.getDsps(), 100.0f * _used.getDsps() / (float) (std::max(1U, _total.getDsps())));
-
 					CResourceUtilisation unusedResources;
 					unusedResources.getSlices() = _total.getSlices() - _used.getSlices();
 					unusedResources.getLuts() = _total.getLuts() - _used.getLuts();
 					unusedResources.getRegisters() = _total.getRegisters() - _used.getRegisters();
 					unusedResources.getRams() = _total.getRams() - _used.getRams();
 					unusedResources.getDsps() = _total.getDsps() - _used.getDsps();
-					CFpgaItem* unused = new CFpgaItem("[UNUSED RESOURCES]", unusedResources, NULL);
+					_treeMapBuilder = new CTreeMapBuilder();
+					CFpgaItem* unused = _treeMapBuilder->createItem("[UNUSED RESOURCES]", unusedResources, NULL);
 					unused->setColour(0xaaaaaa);
-					_treeMapBuilder = new CTreeMapBuilder(unused);
+					_treeMapBuilder->setItems(unused);
 					_items = unused;
 				}
 				break;
@@ -112,7 +134,7 @@ bool CMrpParser::parse()
 			case ESection::TABLE_OF_CONTENTS:
 			{
 				// first time we see this will be in the table of contents
-				if(strcmp(line, "Section 13 - Utilization by Hierarchy\n") == 0)
+				if(line.equals("Section 13 - Utilization by Hierarchy"))
 				{
 					section = ESection::SECTION1;
 				}
@@ -121,7 +143,7 @@ bool CMrpParser::parse()
 			case ESection::SECTION1:
 			{
 				// this is the actual section header
-				if(strcmp(line, "Section 13 - Utilization by Hierarchy\n") == 0)
+				if(line.equals("Section 13 - Utilization by Hierarchy"))
 				{
 					section = ESection::UTILISATION_BY_HEIRACHY;
 				}
@@ -129,106 +151,160 @@ bool CMrpParser::parse()
 			}
 			case ESection::UTILISATION_BY_HEIRACHY:
 			{
-				char* module = strtok(line, "|");
-				strtok(NULL, "|"); // partition
-				char* slices = strtok(NULL, "|");
-				char* registers = strtok(NULL, "|");
-				char* luts = strtok(NULL, "|");
-				strtok(NULL, "|"); // lutram
-				char* rams = strtok(NULL, "|");
-				char* dsps = strtok(NULL, "|");
-
-				//printf("module = '%s' [%p], strstr(module, \"Module\") = %p\n", module, module, strstr(module, "Module"));
-				if(!headerRowSeen && strstr(module, "Module") != NULL)
-				{
-					headerRowSeen = true;
-				}
-				else if(headerRowSeen && module && slices && registers && luts && rams && dsps)
-				{
-					char* trimmedModule = module;
-					if(*module)
-					{
-						// skip leading space character
-						module++;
-						trimmedModule++;
-						while(*trimmedModule)
-						{
-							if(*trimmedModule == ' ')
-							{
-								*trimmedModule = 0;
-								break;
-							}
-							trimmedModule++;
-						}
-					}
-					//printf("\"%s\", %s, %s, %s, %s, %s\n", module, slices, registers, luts, rams, dsps);
-					CResourceUtilisation ru;
-					ru.getSlices() = strtoul(slices, NULL, 10);
-					ru.getRegisters() = strtoul(registers, NULL, 10);
-					ru.getLuts() = strtoul(luts, NULL, 10);
-					ru.getRams() = strtoul(rams, NULL, 10);
-					ru.getDsps() = strtoul(dsps, NULL, 10);
-
-					_treeMapBuilder->addElement(module, ru);
-				}
+				// handled by parseHierarchyTable()
 				break;
 			}
 		}
 	}
 
-	//_items->print(stdout);
-
 	if(section != ESection::UTILISATION_BY_HEIRACHY)
 	{
 		fprintf(stderr, "Unable to find \"Section 13 - Utilization by Hierarchy\" in MAP Report. Is this a detailed MAP report?\n");
 		exit(1);
 	}
 
-	fclose(fh);
+	parseHierarchyTable(data, end);
+
+	//_items->print(stdout);
+
 	return true;
 }
 
-void CMrpParser::extractDesignSummaryValues(const char* haystack, const char* needle, uint32_t& used, uint32_t& total)
+void CMrpParser::printUtilisation(const CResourceUtilisation& used, const CResourceUtilisation& total)
+{
+	printf("Slices      : %6u / %6u (%2.1f%%)\n", used.getSlices(), total.getSlices(), 100.0f * used.getSlices() / (float) (std::max(1U, total.getSlices())));
+	printf("  Luts      : %6u / %6u (%2.1f%%)\n", used.getLuts(), total.getLuts(), 100.0f * used.getLuts() / (float) (std::max(1U, total.getLuts())));
+	printf("  Registers : %6u / %6u (%2.1f%%)\n", used.getRegisters(), total.getRegisters(), 100.0f * used.getRegisters() / (float) (std::max(1U, total.getRegisters())));
+	printf("RAMs        : %6u / %6u (%2.1f%%)\n", used.getRams(), total.getRams(), 100.0f * used.getRams() / (float) (std::max(1U, total.getRams())));
+	printf("DSPs        : %6u / %6u (%2.1f%%)\n", used.getDsps(), total.getDsps(), 100.0f * used.getDsps() / (float) (std::max(1U, total.getDsps())));
+}
+
+void CMrpParser::parseHierarchyTable(const char* begin, const char* end)
+{
+	// Rows only depend on each other through their '+' depth prefix, so the
+	// table is cut into line aligned chunks which are tokenised in parallel.
+	// The hierarchy is then stitched together in order by the tree builder.
+	static const uint64_t MIN_CHUNK_SIZE = 1 << 20;
+
+	const uint64_t tableSize = end - begin;
+	const uint32_t numThreads = std::max(1U, std::thread::hardware_concurrency());
+	const uint32_t numChunks = std::min<uint64_t>(numThreads * 4, tableSize / MIN_CHUNK_SIZE + 1);
+
+	std::vector<const char*> boundaries;
+	boundaries.push_back(begin);
+	for (uint32_t i = 1; i < numChunks; i++)
+	{
+		const char* split = std::max(begin + tableSize * i / numChunks, boundaries.back());
+		const char* newline = static_cast<const char*>(memchr(split, '\n', end - split));
+		boundaries.push_back(newline ? newline + 1 : end);
+	}
+	boundaries.push_back(end);
+
+	std::vector<std::vector<SHierarchyRow>> chunkRows(numChunks);
+	if (numChunks == 1)
+	{
+		parseHierarchyChunk(begin, end, chunkRows[0]);
+	}
+	else
+	{
+		CThreadPool threadPool(std::min(numThreads, numChunks));
+		for (uint32_t i = 0; i < numChunks; i++)
+		{
+			threadPool.submit([&boundaries, &chunkRows, i]()
+			{
+				parseHierarchyChunk(boundaries[i], boundaries[i + 1], chunkRows[i]);
+			});
+		}
+		threadPool.wait();
+	}
+
+	uint32_t numRows = 0;
+	for (const auto& rows : chunkRows)
+	{
+		numRows += rows.size();
+	}
+	_treeMapBuilder->reserve(numRows + 1);
+
+	bool headerRowSeen = false;
+	for (const auto& rows : chunkRows)
+	{
+		for (const auto& row : rows)
+		{
+			if(!headerRowSeen && row.isHeader)
+			{
+				headerRowSeen = true;
+			}
+			else if(headerRowSeen && row.complete)
+			{
+				_treeMapBuilder->addElement(row.module, row.ru);
+			}
+		}
+	}
+	_treeMapBuilder->finish();
+}
+
+void CMrpParser::parseHierarchyChunk(const char* begin, const char* end, std::vector<SHierarchyRow>& rows)
 {
-	const char* startPtr = NULL;
-	if((startPtr = strstr(haystack, needle)) != NULL)
+	// rows are typically a little over 100 characters wide
+	rows.reserve((end - begin) / 100 + 1);
+
+	SHierarchyRow row;
+	const char* data = begin;
+	while (data < end)
 	{
-		startPtr += strlen(needle);
-		uint32_t pLength = strlen(startPtr) + 1;
-		char* pLine = new char[pLength];
-		copyStringKeepingChars(startPtr, pLine, pLength, "0123456789 ");
-		char* endPtr = NULL;
-		used = strtoul(pLine, &endPtr, 10);
-		if(endPtr && *endPtr)
+		const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+		CStringSpan line(data, (newline ? newline : end) - data);
+		data = newline ? newline + 1 : end;
+
+		if (parseHierarchyRow(line, row))
 		{
-			total = strtoul(endPtr, NULL, 10);
+			rows.push_back(row);
 		}
-		delete[] pLine;
 	}
 }
 
-void CMrpParser::copyStringIgnoringChars(const char* src, char* dst, uint32_t dstSize, const char* charsToIgnore)
+bool CMrpParser::parseHierarchyRow(const CStringSpan& line, SHierarchyRow& row)
 {
-	uint32_t numChars = 0;
-	while(*src && numChars < dstSize)
+	// module | partition | slices | registers | luts | lutram | rams | dsps | ...
+	static const uint32_t NUM_COLUMNS = 8;
+	CStringSpan columns[NUM_COLUMNS];
+	uint32_t numColumns = CRowTokeniser::tokenise(line, '|', columns, NUM_COLUMNS);
+
+	CStringSpan module = numColumns ? columns[0] : CStringSpan();
+	bool complete = numColumns == NUM_COLUMNS;
+
+	row.isHeader = module.contains("Module");
+	row.complete = complete;
+	if (!complete)
 	{
-		if(strchr(charsToIgnore, *src) == NULL)
+		return row.isHeader;
+	}
+
+	if(!module.isEmpty())
+	{
+		// skip leading space character, stop at the first trailing one
+		module = module.substr(1);
+		const char* space = static_cast<const char*>(memchr(module.getData(), ' ', module.getLength()));
+		if(space)
 		{
-			*dst = *src;
-			dst++;
-			numChars++;
+			module = module.substr(0, space - module.getData());
 		}
-		src++;
 	}
-	*dst = 0;
+	row.module = module;
+	row.ru.getSlices() = CRowTokeniser::parseDecimal(columns[2]);
+	row.ru.getRegisters() = CRowTokeniser::parseDecimal(columns[3]);
+	row.ru.getLuts() = CRowTokeniser::parseDecimal(columns[4]);
+	row.ru.getRams() = CRowTokeniser::parseDecimal(columns[6]);
+	row.ru.getDsps() = CRowTokeniser::parseDecimal(columns[7]);
+	return true;
 }
 
-void CMrpParser::copyStringKeepingChars(const char* src, char* dst, uint32_t dstSize, const char* charsToKeep)
+void CMrpParser::copyStringIgnoringChars(const char* src, char* dst, uint32_t dstSize, const char* charsToIgnore)
 {
 	uint32_t numChars = 0;
 	while(*src && numChars < dstSize)
 	{
-		if(strchr(charsToKeep, *src) != NULL)
+		if(strchr(charsToIgnore, *src) == NULL)
 		{
 			*dst = *src;
 			dst++;
@@ -238,4 +314,3 @@ void CMrpParser::copyStringKeepingChars(const char* src, char* dst, uint32_t dst
 	}
 	*dst = 0;
 }
-
@@ -2,12 +2,19 @@
 #define SRC_CMRPPARSER_H_
 
 #include <cstdint>
+#include <vector>
 
+#include "CDesignSummaryMatcher.h"
+#include "CMappedFile.h"
 #include "CResourceUtilisation.h"
+#include "CStringSpan.h"
 
 class CTreeMapBuilder;
 class CFpgaItem;
 
+// Parses a Xilinx ISE detailed map report. The report is memory mapped and
+// item names point straight into the mapping, so the parser must outlive the
+// items returned by getItems().
 class CMrpParser
 {
 public:
@@ -15,21 +22,55 @@ public:
 	virtual ~CMrpParser();
 
 	CFpgaItem* getItems() const;
+	const CResourceUtilisation& getUsed() const;
+	const CResourceUtilisation& getTotal() const;
 
 	bool parse();
 
+	static void printUtilisation(const CResourceUtilisation& used, const CResourceUtilisation& total);
+
 private:
+	// One row of the "Utilization by Hierarchy" table, module still carries
+	// its '+' depth prefix.
+	struct SHierarchyRow
+	{
+		CStringSpan module;
+		CResourceUtilisation ru;
+		bool isHeader;
+		bool complete;
+	};
+
+	// "Number of ..." lines of the Design Summary that we read
+	enum EDesignSummaryValue
+	{
+		SLICE_LUTS,
+		SLICE_REGISTERS,
+		OCCUPIED_SLICES,
+		DSP48E1S,
+		DSP48A1S,
+		RAMB8BWERS,
+		RAMB16BWERS,
+		RAMB18E1S,
+		RAMB36E1S,
+		NUM_DESIGN_SUMMARY_VALUES
+	};
+
 	const char* _mapReport;
+	CMappedFile _report;
 
 	CResourceUtilisation _used;
 	CResourceUtilisation _total;
 
+	CDesignSummaryMatcher _designSummaryMatcher;
+
 	CFpgaItem* _items;
 	CTreeMapBuilder* _treeMapBuilder;
 
-	void extractDesignSummaryValues(const char* haystack, const char* needle, uint32_t& used, uint32_t& total);
+	void parseHierarchyTable(const char* begin, const char* end);
+	static void parseHierarchyChunk(const char* begin, const char* end, std::vector<SHierarchyRow>& rows);
+	static bool parseHierarchyRow(const CStringSpan& line, SHierarchyRow& row);
+
 	void copyStringIgnoringChars(const char* src, char* dst, uint32_t dstSize, const char* charsToIgnore);
-	void copyStringKeepingChars(const char* src, char* dst, uint32_t dstSize, const char* charsToKeep);
 };
 
 #endif /* SRC_CMRPPARSER_H_ */
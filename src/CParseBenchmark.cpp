@@ -0,0 +1,238 @@
+#include "CParseBenchmark.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+#include "CFpgaItem.h"
+#include "CMrpParser.h"
+#include "CStringSpan.h"
+#include "CTreeMapBuilder.h"
+
+static const uint32_t SEED = 12345;
+static const char* const NAMES[] = { "u_core", "u_ctrl", "u_dsp", "u_fifo", "u_reg" };
+
+// Design Summary and table of contents as ISE writes them, CMrpParser needs
+// the section heading twice before the table
+static const char* const REPORT_HEADER =
+		"Release 14.7 Map P.20131013 (lin64)\n"
+		"Xilinx Mapping Report File for Design 'top'\n"
+		"\n"
+		"Design Summary\n"
+		"--------------\n"
+		"Slice Logic Utilization:\n"
+		"  Number of Slice Registers:                34,123 out of 301,440   11%\n"
+		"  Number of Slice LUTs:                     40,321 out of 150,720   26%\n"
+		"  Number of occupied Slices:                15,000 out of  37,680   39%\n"
+		"  Number of RAMB36E1/FIFO36E1s:                 20 out of     416    4%\n"
+		"  Number of RAMB18E1/FIFO18E1s:                 10 out of     832    1%\n"
+		"  Number of DSP48E1s:                           30 out of     768    3%\n"
+		"\n"
+		"Table of Contents\n"
+		"-----------------\n"
+		"Section 13 - Utilization by Hierarchy\n"
+		"\n"
+		"Section 13 - Utilization by Hierarchy\n"
+		"-------------------------------------\n"
+		"+------------------------------------------------------------------------------------------------------------------------------------------------------+\n"
+		"| Module   | Partition | Slices*  | Slice Reg | LUTs  | LUTRAM | BRAM/FIFO | DSP48E1 | BUFG | Full Hierarchical Name |\n"
+		"+------------------------------------------------------------------------------------------------------------------------------------------------------+\n";
+
+CParseBenchmark::CParseBenchmark(uint32_t numRows, uint32_t maxDepth) :
+		_maxDepth(maxDepth)
+{
+	generate(numRows);
+}
+
+CParseBenchmark::~CParseBenchmark()
+{
+	if (!_filename.empty())
+	{
+		unlink(_filename.c_str());
+	}
+}
+
+void CParseBenchmark::generate(uint32_t numRows)
+{
+	std::mt19937 random(SEED);
+	_rows.resize(numRows);
+
+	// One root row, then each row mostly goes a level deeper, otherwise it
+	// climbs back up to seven, staying a sibling when it climbs none. Most
+	// rows end up close to maxDepth, where finding the parent is slowest.
+	uint32_t depth = 0;
+	for (uint32_t i = 0; i < numRows; i++)
+	{
+		SRow& row = _rows[i];
+		if (i == 0)
+		{
+			row.module = "top/";
+		}
+		else
+		{
+			if (depth < _maxDepth && random() % 8 != 0)
+			{
+				depth++;
+			}
+			else
+			{
+				const uint32_t climb = random() % 8;
+				depth = depth > climb ? depth - climb : 1;
+			}
+			row.module.assign(depth, '+');
+			if (random() % 16 == 0)
+			{
+				row.module += "gen_bank[" + std::to_string(random() % 100) + "].u_cell";
+			}
+			else
+			{
+				row.module += NAMES[random() % (sizeof(NAMES) / sizeof(NAMES[0]))];
+			}
+		}
+
+		row.ru.getSlices() = random() % 128;
+		row.ru.getRegisters() = random() % 1024;
+		row.ru.getLuts() = random() % 1024;
+		row.ru.getRams() = random() % 8 == 0;
+		row.ru.getDsps() = random() % 32 == 0;
+	}
+}
+
+bool CParseBenchmark::write()
+{
+	char filename[] = "/tmp/fpga-tree-map-XXXXXX";
+	int fd = mkstemp(filename);
+	FILE* fh = fd >= 0 ? fdopen(fd, "w") : NULL;
+	if (!fh)
+	{
+		fprintf(stderr, "%s::%s error creating %s\n", __FILE__, __FUNCTION__, filename);
+		return false;
+	}
+	_filename = filename;
+
+	// the second number of each column is the total of the subtree, which
+	// the parser ignores
+	fputs(REPORT_HEADER, fh);
+	for (const SRow& row : _rows)
+	{
+		fprintf(fh, "| %-20s |           | %u/%-6u | %u/%-6u | %u/%-6u | 0/0     | %u/%-4u | %u/%-4u | 0/0 | top/%s |\n", row.module.c_str(),
+				row.ru.getSlices(), row.ru.getSlices(), row.ru.getRegisters(), row.ru.getRegisters(), row.ru.getLuts(), row.ru.getLuts(),
+				row.ru.getRams(), row.ru.getRams(), row.ru.getDsps(), row.ru.getDsps(), row.module.c_str() + row.module.find_first_not_of('+'));
+	}
+	fputs("+------------------------------------------------------------------------------------------------------------------------------------------------------+\n", fh);
+
+	if (fclose(fh) != 0)
+	{
+		fprintf(stderr, "%s::%s error writing %s\n", __FILE__, __FUNCTION__, filename);
+		return false;
+	}
+	return true;
+}
+
+template <typename ADD>
+double CParseBenchmark::time(uint32_t repetitions, ADD add)
+{
+	double milliseconds = 0;
+
+	// once more to warm the caches
+	for (uint32_t r = 0; r <= repetitions; r++)
+	{
+		// as CMrpParser sets it up, allocation up front is not timed
+		CTreeMapBuilder builder;
+		builder.reserve(_rows.size() + 1);
+		builder.setItems(builder.createItem("[UNUSED RESOURCES]", CResourceUtilisation(), NULL));
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		add(builder);
+		if (r)
+		{
+			milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+	return milliseconds / repetitions;
+}
+
+void CParseBenchmark::addElementsByWalk(CTreeMapBuilder& builder, const std::vector<SRow>& rows)
+{
+	CFpgaItem* lastItem = NULL;
+	for (const SRow& row : rows)
+	{
+		const CStringSpan module(row.module.data(), row.module.size());
+		uint32_t depth = 0;
+		while (depth < module.getLength() && module[depth] == '+')
+		{
+			depth++;
+		}
+
+		// as in the previous version the root row hangs off [UNUSED
+		// RESOURCES] at depth 1, as do the depth 1 rows
+		CFpgaItem* parent = builder.getItems();
+		if (lastItem)
+		{
+			const uint32_t lastDepth = lastItem->getDepth();
+			parent = lastItem;
+			if (depth <= lastDepth)
+			{
+				uint32_t parentDepth = lastDepth;
+				while (parentDepth >= depth)
+				{
+					parent = parent->getParent();
+					parentDepth--;
+				}
+			}
+		}
+		lastItem = builder.createItem(module.substr(depth), row.ru, parent);
+	}
+}
+
+bool CParseBenchmark::run(uint32_t repetitions)
+{
+	if (!write())
+	{
+		return false;
+	}
+
+	uint64_t sumDepths = 0;
+	for (const SRow& row : _rows)
+	{
+		sumDepths += row.module.find_first_not_of('+');
+	}
+	printf("%zu rows, %u levels deep, mean depth %.1f, mean of %u runs\n", _rows.size(), _maxDepth, (double) sumDepths / _rows.size(), repetitions);
+
+	const std::vector<SRow>& rows = _rows;
+	const double stack = time(repetitions, [&rows](CTreeMapBuilder& builder)
+	{
+		for (const SRow& row : rows)
+		{
+			builder.addElement(CStringSpan(row.module.data(), row.module.size()), row.ru);
+		}
+	});
+	const double walk = time(repetitions, [&rows](CTreeMapBuilder& builder)
+	{
+		addElementsByWalk(builder, rows);
+	});
+
+	// the whole parse: map the file, tokenise, attach the rows, finish()
+	double parse = 0;
+	for (uint32_t r = 0; r <= repetitions; r++)
+	{
+		CMrpParser parser(_filename.c_str());
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!parser.parse())
+		{
+			return false;
+		}
+		if (r)
+		{
+			parse += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+	parse /= repetitions;
+
+	printf("  addElement, ancestor stack %8.2f ms\n", stack);
+	printf("  addElement, parent walk    %8.2f ms  %.2fx\n", walk, walk / stack);
+	printf("  CMrpParser::parse()        %8.2f ms\n", parse);
+	return true;
+}
@@ -0,0 +1,46 @@
+#ifndef SRC_CPARSEBENCHMARK_H_
+#define SRC_CPARSEBENCHMARK_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CResourceUtilisation.h"
+
+class CTreeMapBuilder;
+
+// Writes a synthetic map report of numRows hierarchy rows up to maxDepth
+// levels deep to a temporary file, then times CMrpParser::parse() on it and
+// CTreeMapBuilder::addElement() on its rows. addElement() is compared with
+// the parent chain walk it replaced. The rows come from a fixed seed, so runs
+// compare.
+class CParseBenchmark
+{
+public:
+	CParseBenchmark(uint32_t numRows, uint32_t maxDepth);
+	~CParseBenchmark();
+
+	bool run(uint32_t repetitions);
+
+private:
+	struct SRow
+	{
+		// with its '+' depth prefix
+		std::string module;
+		CResourceUtilisation ru;
+	};
+
+	void generate(uint32_t numRows);
+	bool write();
+	// milliseconds per pass over the rows into a new builder
+	template <typename ADD>
+	double time(uint32_t repetitions, ADD add);
+	// the previous addElement(), which walked up from the last item
+	static void addElementsByWalk(CTreeMapBuilder& builder, const std::vector<SRow>& rows);
+
+	uint32_t _maxDepth;
+	std::vector<SRow> _rows;
+	std::string _filename;
+};
+
+#endif /* SRC_CPARSEBENCHMARK_H_ */
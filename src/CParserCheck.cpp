@@ -0,0 +1,127 @@
+#include "CParserCheck.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "CFpgaItem.h"
+#include "CMrpParser.h"
+
+static const uint32_t NUM_IMPLEMENTATIONS = 3;
+static const char* const IMPLEMENTATION_NAMES[NUM_IMPLEMENTATIONS] = { "scalar", "sse2", "avx2" };
+static const CRowTokeniser::EImplementation IMPLEMENTATIONS[NUM_IMPLEMENTATIONS] = { CRowTokeniser::EImplementation::SCALAR, CRowTokeniser::EImplementation::SSE2, CRowTokeniser::EImplementation::AVX2 };
+
+CParserCheck::CParserCheck(const char* mapReport) :
+		_mapReport(mapReport)
+{
+
+}
+
+CParserCheck::~CParserCheck()
+{
+
+}
+
+bool CParserCheck::check()
+{
+	const CRowTokeniser::EImplementation implementation = CRowTokeniser::getImplementation();
+
+	// the scalar tree is the reference, it must outlive the others
+	CRowTokeniser::setImplementation(CRowTokeniser::EImplementation::SCALAR);
+	CMrpParser reference(_mapReport);
+	if (!reference.parse())
+	{
+		CRowTokeniser::setImplementation(implementation);
+		return false;
+	}
+
+	bool passed = true;
+	for (uint32_t i = 1; i < NUM_IMPLEMENTATIONS; i++)
+	{
+		if (!CRowTokeniser::setImplementation(IMPLEMENTATIONS[i]))
+		{
+			printf("%-7s not supported by this CPU\n", IMPLEMENTATION_NAMES[i]);
+			continue;
+		}
+
+		CMrpParser parser(_mapReport);
+		if (!parser.parse())
+		{
+			passed = false;
+			continue;
+		}
+
+		uint32_t numItems = 0;
+		if (compare(reference.getItems(), parser.getItems(), IMPLEMENTATION_NAMES[i], numItems))
+		{
+			printf("%-7s %u items identical to the scalar tree\n", IMPLEMENTATION_NAMES[i], numItems);
+		}
+		else
+		{
+			passed = false;
+		}
+	}
+
+	CRowTokeniser::setImplementation(implementation);
+	return passed;
+}
+
+bool CParserCheck::compare(CFpgaItem* expected, CFpgaItem* actual, const char* implementationName, uint32_t& numItems)
+{
+	struct SPair
+	{
+		CFpgaItem* expected;
+		CFpgaItem* actual;
+		uint32_t depth;
+	};
+
+	// explicit stack, synthetic reports can be deep
+	std::vector<SPair> stack;
+	stack.push_back({ expected, actual, 0 });
+	while (!stack.empty())
+	{
+		const SPair pair = stack.back();
+		stack.pop_back();
+		numItems++;
+
+		const CStringSpan& name = pair.expected->getName();
+		const CStringSpan& actualName = pair.actual->getName();
+		const CResourceUtilisation& ru = pair.expected->getResourceUtilisation();
+		const CResourceUtilisation& actualRu = pair.actual->getResourceUtilisation();
+
+		const char* difference = NULL;
+		if (name.getLength() != actualName.getLength() || memcmp(name.getData(), actualName.getData(), name.getLength()) != 0)
+		{
+			difference = "name";
+		}
+		else if (pair.expected->getDepth() != pair.depth || pair.actual->getDepth() != pair.depth)
+		{
+			difference = "depth";
+		}
+		else if (pair.expected->getNumChildren() != pair.actual->getNumChildren())
+		{
+			difference = "number of children";
+		}
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS && !difference; m++)
+		{
+			if (ru.get(static_cast<EUtilisationMetric>(m)) != actualRu.get(static_cast<EUtilisationMetric>(m)))
+			{
+				difference = "size";
+			}
+		}
+
+		if (difference)
+		{
+			fprintf(stderr, "%s: %s of item %u (%.*s, depth %u) differs from the scalar tree\n", implementationName, difference, numItems,
+					name.getLength(), name.getData(), pair.depth);
+			return false;
+		}
+
+		// last child first, so items are visited in report order
+		for (uint32_t c = pair.expected->getNumChildren(); c-- > 0;)
+		{
+			stack.push_back({ pair.expected->getChildByIndex(c), pair.actual->getChildByIndex(c), pair.depth + 1 });
+		}
+	}
+	return true;
+}
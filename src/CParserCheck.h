@@ -0,0 +1,28 @@
+#ifndef SRC_CPARSERCHECK_H_
+#define SRC_CPARSERCHECK_H_
+
+#include <cstdint>
+
+#include "CRowTokeniser.h"
+
+class CFpgaItem;
+
+// Parses a map report once with every CRowTokeniser implementation the CPU
+// supports and checks that the SIMD ones build the same tree as the scalar
+// one: names, sizes, depth and child order of every item.
+class CParserCheck
+{
+public:
+	CParserCheck(const char* mapReport);
+	~CParserCheck();
+
+	bool check();
+
+private:
+	// reports the first item that differs, walking both trees in child order
+	static bool compare(CFpgaItem* expected, CFpgaItem* actual, const char* implementationName, uint32_t& numItems);
+
+	const char* _mapReport;
+};
+
+#endif /* SRC_CPARSERCHECK_H_ */
@@ -0,0 +1,117 @@
+#include "CRenderThread.h"
+
+#include <chrono>
+
+#include "CSnapshot.h"
+#include "windirstat/CRect.h"
+
+CRenderThread::SFrame::SFrame(CTreeMap::Callback* callback, uint32_t width, uint32_t height) :
+		treeMap(callback),
+		frameBuffer(width, height),
+		node(CSnapshot::NO_NODE),
+		metric(EUtilisationMetric::REG),
+		renderMilliseconds(0)
+{
+
+}
+
+CRenderThread::CRenderThread(CThreadPool* pool, uint32_t width, uint32_t height, const std::function<void()>& frameReady) :
+		_drawing(0),
+		_ready(1),
+		_displayed(2),
+		_haveDisplayed(false),
+		_frameReady(frameReady),
+		_stopping(false)
+{
+	for (uint32_t f = 0; f < NUM_FRAMES; f++)
+	{
+		_frames[f].reset(new SFrame(this, width, height));
+		_frames[f]->treeMap.SetThreadPool(pool);
+	}
+	_thread = std::thread(&CRenderThread::renderLoop, this);
+}
+
+CRenderThread::~CRenderThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_requestAvailable.notify_one();
+	_thread.join();
+}
+
+void CRenderThread::request(const SRequest& request)
+{
+	// The render thread drains the queue before every frame, so it is
+	// only ever full for a moment
+	while (!_requests.push(request))
+	{
+		std::this_thread::yield();
+	}
+	// Taking the lock orders the push before the render thread's check
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+	}
+	_requestAvailable.notify_one();
+}
+
+const CRenderThread::SFrame* CRenderThread::acquireFrame()
+{
+	if (_ready.load(std::memory_order_acquire) & FRAME_FRESH)
+	{
+		_displayed = _ready.exchange(_displayed, std::memory_order_acq_rel) & FRAME_MASK;
+		_haveDisplayed = true;
+	}
+	return _haveDisplayed ? _frames[_displayed].get() : NULL;
+}
+
+bool CRenderThread::isFrameReady() const
+{
+	return (_ready.load(std::memory_order_acquire) & FRAME_FRESH) != 0;
+}
+
+void CRenderThread::TreemapDrawingCallback()
+{
+	// Nobody wants this frame any more
+	if (!_requests.empty())
+	{
+		_frames[_drawing]->treeMap.Cancel();
+	}
+}
+
+void CRenderThread::renderLoop()
+{
+	while (1)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_requestAvailable.wait(lock, [this] { return _stopping || !_requests.empty(); });
+			if (_stopping)
+			{
+				return;
+			}
+		}
+
+		// Only the newest request matters
+		SRequest request;
+		while (_requests.pop(request))
+		{
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		SFrame& frame = *_frames[_drawing];
+		frame.frameBuffer.fillSolidRect(CRect(0, 0, frame.frameBuffer.getWidth(), frame.frameBuffer.getHeight()), 0);
+		frame.treeMap.DrawTreemap(&frame.frameBuffer, CRect(0, 0, frame.frameBuffer.getWidth(), frame.frameBuffer.getHeight()), CSnapshot::View(request.snapshot, request.metric), request.node, &request.options);
+		if (frame.treeMap.WasCancelled())
+		{
+			continue;
+		}
+		frame.node = request.node;
+		frame.metric = request.metric;
+		frame.renderMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		_drawing = _ready.exchange(_drawing | FRAME_FRESH, std::memory_order_acq_rel) & FRAME_MASK;
+		_frameReady();
+	}
+}
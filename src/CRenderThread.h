@@ -0,0 +1,91 @@
+#ifndef SRC_CRENDERTHREAD_H_
+#define SRC_CRENDERTHREAD_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "CFrameBuffer.h"
+#include "CSpscQueue.h"
+#include "EUtilisationMetric.h"
+#include "windirstat/CTreeMap.h"
+
+class CSnapshot;
+class CThreadPool;
+
+// Draws treemaps off the display thread. Requests come in through a
+// lock-free queue, a newer request cancels the render in progress, and
+// finished frames are handed back through a triple buffer so neither
+// side ever waits for the other.
+class CRenderThread : public CTreeMap::Callback
+{
+public:
+	struct SRequest
+	{
+		const CSnapshot* snapshot;
+		uint32_t node;
+		EUtilisationMetric metric;
+		CTreeMap::Options options;
+	};
+
+	// A finished treemap and the layout it was drawn from, for hit testing
+	struct SFrame
+	{
+		SFrame(CTreeMap::Callback* callback, uint32_t width, uint32_t height);
+
+		CTreeMap treeMap;
+		CFrameBuffer frameBuffer;
+		uint32_t node;
+		EUtilisationMetric metric;
+		double renderMilliseconds;
+	};
+
+	// frameReady is called on the render thread after each new frame
+	CRenderThread(CThreadPool* pool, uint32_t width, uint32_t height, const std::function<void()>& frameReady);
+	~CRenderThread();
+
+	// Display thread only
+	void request(const SRequest& request);
+	// The newest finished frame, NULL until there is one. Stays valid
+	// until the next call.
+	const SFrame* acquireFrame();
+	// Whether acquireFrame() has something new
+	bool isFrameReady() const;
+
+	virtual void TreemapDrawingCallback();
+
+private:
+	CRenderThread(const CRenderThread&) = delete;
+	CRenderThread& operator=(const CRenderThread&) = delete;
+
+	void renderLoop();
+
+	static const uint32_t NUM_FRAMES = 3;
+	static const uint32_t FRAME_MASK = 0x3;
+	// set in _ready when the frame there hasn't been acquired yet
+	static const uint32_t FRAME_FRESH = 0x4;
+
+	std::unique_ptr<SFrame> _frames[NUM_FRAMES];
+	// Each frame is owned by exactly one of these, ownership only ever
+	// changes by swapping with _ready
+	uint32_t _drawing;
+	std::atomic<uint32_t> _ready;
+	uint32_t _displayed;
+	bool _haveDisplayed;
+
+	CSpscQueue<SRequest, 16> _requests;
+	std::function<void()> _frameReady;
+
+	// only for sleeping while there is nothing to do
+	std::mutex _mutex;
+	std::condition_variable _requestAvailable;
+	bool _stopping;
+
+	std::thread _thread;
+};
+
+#endif /* SRC_CRENDERTHREAD_H_ */
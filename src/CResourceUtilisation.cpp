@@ -63,3 +63,22 @@ uint32_t CResourceUtilisation::getSlices() const
 	return _slices;
 }
 
+
+uint32_t CResourceUtilisation::get(EUtilisationMetric metric) const
+{
+	switch (metric)
+	{
+		case EUtilisationMetric::SLICE:
+			return _slices;
+		case EUtilisationMetric::REG:
+			return _registers;
+		case EUtilisationMetric::LUT:
+			return _luts;
+		case EUtilisationMetric::RAM:
+			return _rams;
+		case EUtilisationMetric::DSP:
+			return _dsps;
+		default:
+			return 0;
+	}
+}
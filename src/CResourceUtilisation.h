@@ -3,6 +3,8 @@
 
 #include <cstdint>
 
+#include "EUtilisationMetric.h"
+
 class CResourceUtilisation
 {
 public:
@@ -21,6 +23,11 @@ public:
 	uint32_t getRegisters() const;
 	uint32_t getSlices() const;
 
+	uint32_t get(EUtilisationMetric metric) const;
+	// the same without the switch
+	template <EUtilisationMetric METRIC>
+	uint32_t get() const;
+
 private:
 	uint32_t _registers;
 	uint32_t _luts;
@@ -30,4 +37,34 @@ private:
 
 };
 
+template <>
+inline uint32_t CResourceUtilisation::get<EUtilisationMetric::SLICE>() const
+{
+	return _slices;
+}
+
+template <>
+inline uint32_t CResourceUtilisation::get<EUtilisationMetric::REG>() const
+{
+	return _registers;
+}
+
+template <>
+inline uint32_t CResourceUtilisation::get<EUtilisationMetric::LUT>() const
+{
+	return _luts;
+}
+
+template <>
+inline uint32_t CResourceUtilisation::get<EUtilisationMetric::DSP>() const
+{
+	return _dsps;
+}
+
+template <>
+inline uint32_t CResourceUtilisation::get<EUtilisationMetric::RAM>() const
+{
+	return _rams;
+}
+
 #endif /* SRC_CRESOURCEUTILISATION_H_ */
@@ -0,0 +1,264 @@
+#include "CRowTokeniser.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ROW_TOKENISER_X86
+#include <immintrin.h>
+#endif
+
+CRowTokeniser::EImplementation CRowTokeniser::_implementation = CRowTokeniser::detectImplementation();
+
+CRowTokeniser::TokeniseFunction CRowTokeniser::_tokenise = NULL;
+
+CRowTokeniser::ParseDecimalFunction CRowTokeniser::_parseDecimal = NULL;
+
+namespace
+{
+
+// Shared by all implementations: given the bitmask of delimiter positions in
+// the block starting at blockStart, emit the non-empty tokens it closes.
+inline bool emitTokens(uint32_t mask, const char* blockStart, const char*& tokenStart, CStringSpan* tokens, uint32_t& numTokens, uint32_t maxTokens)
+{
+	while (mask)
+	{
+		const char* delimiter = blockStart + __builtin_ctz(mask);
+		if (delimiter != tokenStart)
+		{
+			tokens[numTokens++] = CStringSpan(tokenStart, delimiter - tokenStart);
+			if (numTokens == maxTokens)
+			{
+				return true;
+			}
+		}
+		tokenStart = delimiter + 1;
+		mask &= mask - 1;
+	}
+	return false;
+}
+
+inline uint32_t tokeniseTail(const char* data, const char* end, const char* tokenStart, char delimiter, CStringSpan* tokens, uint32_t numTokens, uint32_t maxTokens)
+{
+	for (; data < end; data++)
+	{
+		if (*data == delimiter)
+		{
+			if (data != tokenStart)
+			{
+				tokens[numTokens++] = CStringSpan(tokenStart, data - tokenStart);
+				if (numTokens == maxTokens)
+				{
+					return numTokens;
+				}
+			}
+			tokenStart = data + 1;
+		}
+	}
+	if (end != tokenStart && numTokens < maxTokens)
+	{
+		tokens[numTokens++] = CStringSpan(tokenStart, end - tokenStart);
+	}
+	return numTokens;
+}
+
+}
+
+CRowTokeniser::EImplementation CRowTokeniser::detectImplementation()
+{
+#ifdef ROW_TOKENISER_X86
+	// we may run before the constructors that normally do this
+	__builtin_cpu_init();
+#endif
+
+	EImplementation implementation = EImplementation::SCALAR;
+	if (isSupported(EImplementation::AVX2))
+	{
+		implementation = EImplementation::AVX2;
+	}
+	else if (isSupported(EImplementation::SSE2))
+	{
+		implementation = EImplementation::SSE2;
+	}
+	setImplementation(implementation);
+	return implementation;
+}
+
+CRowTokeniser::EImplementation CRowTokeniser::getImplementation()
+{
+	return _implementation;
+}
+
+bool CRowTokeniser::setImplementation(EImplementation implementation)
+{
+	if (!isSupported(implementation))
+	{
+		return false;
+	}
+
+	_implementation = implementation;
+	switch (implementation)
+	{
+		case EImplementation::AVX2:
+			_tokenise = &tokeniseAvx2;
+			_parseDecimal = &parseDecimalSwar;
+			break;
+		case EImplementation::SSE2:
+			_tokenise = &tokeniseSse2;
+			_parseDecimal = &parseDecimalSwar;
+			break;
+		default:
+			_tokenise = &tokeniseScalar;
+			_parseDecimal = &parseDecimalScalar;
+			break;
+	}
+	return true;
+}
+
+bool CRowTokeniser::isSupported(EImplementation implementation)
+{
+	switch (implementation)
+	{
+#ifdef ROW_TOKENISER_X86
+		case EImplementation::AVX2:
+			return __builtin_cpu_supports("avx2");
+		case EImplementation::SSE2:
+			return __builtin_cpu_supports("sse2");
+#endif
+		case EImplementation::SCALAR:
+			return true;
+		default:
+			return false;
+	}
+}
+
+uint32_t CRowTokeniser::tokeniseScalar(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens)
+{
+	if (maxTokens == 0)
+	{
+		return 0;
+	}
+	return tokeniseTail(line.getData(), line.getData() + line.getLength(), line.getData(), delimiter, tokens, 0, maxTokens);
+}
+
+#ifdef ROW_TOKENISER_X86
+
+__attribute__((target("sse2")))
+uint32_t CRowTokeniser::tokeniseSse2(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens)
+{
+	if (maxTokens == 0)
+	{
+		return 0;
+	}
+
+	const char* data = line.getData();
+	const char* end = data + line.getLength();
+	const char* tokenStart = data;
+	uint32_t numTokens = 0;
+
+	const __m128i delimiters = _mm_set1_epi8(delimiter);
+	for (; end - data >= 16; data += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, delimiters));
+		if (emitTokens(mask, data, tokenStart, tokens, numTokens, maxTokens))
+		{
+			return numTokens;
+		}
+	}
+	return tokeniseTail(data, end, tokenStart, delimiter, tokens, numTokens, maxTokens);
+}
+
+__attribute__((target("avx2")))
+uint32_t CRowTokeniser::tokeniseAvx2(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens)
+{
+	if (maxTokens == 0)
+	{
+		return 0;
+	}
+
+	const char* data = line.getData();
+	const char* end = data + line.getLength();
+	const char* tokenStart = data;
+	uint32_t numTokens = 0;
+
+	const __m256i delimiters = _mm256_set1_epi8(delimiter);
+	for (; end - data >= 32; data += 32)
+	{
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, delimiters));
+		if (emitTokens(mask, data, tokenStart, tokens, numTokens, maxTokens))
+		{
+			return numTokens;
+		}
+	}
+	return tokeniseTail(data, end, tokenStart, delimiter, tokens, numTokens, maxTokens);
+}
+
+#else
+
+uint32_t CRowTokeniser::tokeniseSse2(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens)
+{
+	return tokeniseScalar(line, delimiter, tokens, maxTokens);
+}
+
+uint32_t CRowTokeniser::tokeniseAvx2(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens)
+{
+	return tokeniseScalar(line, delimiter, tokens, maxTokens);
+}
+
+#endif
+
+uint32_t CRowTokeniser::parseDecimalScalar(const CStringSpan& token)
+{
+	return token.toUint32();
+}
+
+uint32_t CRowTokeniser::parseDecimalSwar(const CStringSpan& token)
+{
+	const char* data = token.getData();
+	const char* end = data + token.getLength();
+
+	while (data < end && (*data == ' ' || *data == '\t'))
+	{
+		data++;
+	}
+	if (data < end && *data == '+')
+	{
+		data++;
+	}
+
+	uint32_t value = 0;
+	while (data < end)
+	{
+		// Load up to 8 characters, missing ones become NULs which are not digits
+		uint64_t chunk = 0;
+		uint32_t available = end - data < 8 ? end - data : 8;
+		memcpy(&chunk, data, available);
+
+		// A byte is a digit when both its high nibble and that of byte + 6 are 3
+		const uint64_t nonDigits = ((chunk & 0xf0f0f0f0f0f0f0f0ULL) ^ 0x3030303030303030ULL)
+				| (((chunk + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) ^ 0x3030303030303030ULL);
+		const uint32_t numDigits = nonDigits ? __builtin_ctzll(nonDigits) / 8 : 8;
+		if (numDigits == 0)
+		{
+			break;
+		}
+
+		// Move the digits to the top so the empty low bytes act as leading
+		// zeros, then combine pairs, quads and octets of digits.
+		uint64_t digits = (chunk & 0x0f0f0f0f0f0f0f0fULL) << (8 * (8 - numDigits));
+		digits = (digits * 10 + (digits >> 8)) & 0x00ff00ff00ff00ffULL;
+		digits = (digits * 100 + (digits >> 16)) & 0x0000ffff0000ffffULL;
+		digits = (digits * 10000 + (digits >> 32)) & 0x00000000ffffffffULL;
+
+		static const uint32_t powersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+		value = value * powersOfTen[numDigits] + digits;
+
+		if (numDigits < 8)
+		{
+			break;
+		}
+		data += 8;
+	}
+	return value;
+}
@@ -0,0 +1,63 @@
+#ifndef SRC_CROWTOKENISER_H_
+#define SRC_CROWTOKENISER_H_
+
+#include <cstdint>
+
+#include "CStringSpan.h"
+
+// Splits '|' separated report rows into tokens and decodes the numeric
+// columns. The delimiter scan uses SSE2 or AVX2 when the CPU supports it and
+// falls back to a scalar loop otherwise. Static members only.
+class CRowTokeniser
+{
+public:
+	enum class EImplementation
+	{
+		SCALAR,
+		SSE2,
+		AVX2
+	};
+
+	// strtok() compatible: empty tokens are skipped. Stops after maxTokens
+	// tokens and returns the number found.
+	static uint32_t tokenise(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens);
+
+	// strtoul() compatible for the non-negative decimals found in reports:
+	// skips leading whitespace, then decodes up to 8 digits at a time, or one
+	// at a time with the SCALAR implementation.
+	static uint32_t parseDecimal(const CStringSpan& token);
+
+	// Implementation picked at startup, can be overridden for comparisons.
+	static EImplementation getImplementation();
+	static bool setImplementation(EImplementation implementation);
+	static bool isSupported(EImplementation implementation);
+
+	static uint32_t tokeniseScalar(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens);
+	static uint32_t tokeniseSse2(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens);
+	static uint32_t tokeniseAvx2(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens);
+
+	static uint32_t parseDecimalScalar(const CStringSpan& token);
+	static uint32_t parseDecimalSwar(const CStringSpan& token);
+
+private:
+	typedef uint32_t (*TokeniseFunction)(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens);
+	typedef uint32_t (*ParseDecimalFunction)(const CStringSpan& token);
+
+	static EImplementation detectImplementation();
+
+	static EImplementation _implementation;
+	static TokeniseFunction _tokenise;
+	static ParseDecimalFunction _parseDecimal;
+};
+
+inline uint32_t CRowTokeniser::tokenise(const CStringSpan& line, char delimiter, CStringSpan* tokens, uint32_t maxTokens)
+{
+	return _tokenise(line, delimiter, tokens, maxTokens);
+}
+
+inline uint32_t CRowTokeniser::parseDecimal(const CStringSpan& token)
+{
+	return _parseDecimal(token);
+}
+
+#endif /* SRC_CROWTOKENISER_H_ */
@@ -1,25 +1,42 @@
 #include "CSdlDisplay.h"
 
+#include <SDL/SDL_syswm.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
 #include <X11/Xlib.h>
 #include <mutex>
 #include <math.h>
 #include <unistd.h>
 #include <algorithm>
+#include <chrono>
 
 #include "windirstat/CRect.h"
 #include "windirstat/CTreeMap.h"
-#include "CFpgaItem.h"
+#include "CSnapshot.h"
+
+const char* const CSdlDisplay::CAPTION = "Unusual Object Detector";
 
 CSdlDisplay::CSdlDisplay() :
+		_frame(NULL),
 		_treeMapImage(NULL),
 		_screen(NULL),
-		_treeMap(NULL),
-		_unusedItem(NULL),
-		_selectedItem(NULL),
-		_itemToDraw(NULL),
+		_screenBuffer(NULL),
+		_renderThread(NULL),
+		_metric(EUtilisationMetric::REG),
+		_options(CTreeMap::GetDefaultOptions()),
+		_snapshot(NULL),
+		_selectedNode(CSnapshot::NO_NODE),
+		_nodeToDraw(CSnapshot::NO_NODE),
 		_treeMapRedrawRequired(false),
 		_selectedRedrawRequired(false),
+		_numOutlineStrips(0),
+		_damageTracking(false),
+		_numFrames(0),
+		_numWakeups(0),
+		_eventFd(-1),
 		_windowWidth(900),
 		_windowHeight(900)
 {
@@ -36,14 +53,36 @@ CSdlDisplay::CSdlDisplay() :
 		SDL_Quit();
 		exit(1);
 	}
-	SDL_WM_SetCaption("Unusual Object Detector", "Unusual Object Detector");
+	SDL_WM_SetCaption(CAPTION, CAPTION);
+
+	// With a real second buffer what is on screen isn't what we draw on
+	// next, so only a single buffered surface can be patched in place
+	_damageTracking = (_screen->flags & SDL_DOUBLEBUF) == 0;
+
+	// SDL 1.2's SDL_WaitEvent() wakes up every 10 ms to poll, so on X11
+	// we sleep on the connection ourselves
+	SDL_SysWMinfo info;
+	SDL_VERSION(&info.version);
+	if (SDL_GetWMInfo(&info) == 1 && info.subsystem == SDL_SYSWM_X11)
+	{
+		_eventFd = ConnectionNumber(info.info.x11.display);
+	}
+
+	if (pipe2(_wakePipe, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+		fprintf(stderr, "Could not create wake up pipe: %s\n", strerror(errno));
+		SDL_Quit();
+		exit(1);
+	}
 
-	_treeMapImage = new uint8_t[_windowHeight * _windowWidth * 4];
+	_screenBuffer = new CFrameBuffer(static_cast<uint32_t*>(_screen->pixels), _windowWidth, _windowHeight, _screen->pitch / 4);
 }
 
 CSdlDisplay::~CSdlDisplay()
 {
-	delete[] _treeMapImage;
+	delete _screenBuffer;
+	close(_wakePipe[0]);
+	close(_wakePipe[1]);
 
 	SDL_QUIT();
 }
@@ -58,297 +97,375 @@ uint32_t CSdlDisplay::getHeight() const
 	return _windowHeight;
 }
 
-void CSdlDisplay::setPixel(int x, int y, uint32_t pixel)
-{
-	uint8_t *target_pixel = (uint8_t *) _screen->pixels + y * _screen->pitch + x * 4;
-	*(uint32_t *) target_pixel = pixel;
-}
-
-uint32_t CSdlDisplay::setColour(uint8_t r, uint8_t g, uint8_t b)
+void CSdlDisplay::swapBuffers()
 {
-	uint32_t pixel = b + (g << 8) + (r << 16);
-	return pixel;
+	SDL_Flip(_screen);
 }
 
-void CSdlDisplay::fillSolidRect(const CRect& rect, uint32_t colour)
+void CSdlDisplay::wake()
 {
-	for (uint32_t y = rect.getTop(); y < rect.getBottom(); y++)
+	// The event is for SDL_WaitEvent(), the byte for poll()
+	SDL_Event event;
+	event.type = SDL_USEREVENT;
+	if (SDL_PushEvent(&event) != 0)
 	{
-		for (uint32_t x = rect.getLeft(); x < rect.getRight(); x++)
-		{
-			uint8_t *target_pixel = (uint8_t *) _screen->pixels + y * _screen->pitch + x * 4;
-			*(uint32_t *) target_pixel = colour;
-		}
+		fprintf(stderr, "Could not push SDL event: %s\n", SDL_GetError());
+	}
+	const uint8_t byte = 0;
+	// A full pipe is already going to wake us
+	if (write(_wakePipe[1], &byte, 1) < 0 && errno != EAGAIN)
+	{
+		fprintf(stderr, "Could not write wake up pipe: %s\n", strerror(errno));
 	}
 }
 
-void CSdlDisplay::drawRectEdge(const CRect& rect, uint32_t colour)
-{
-	drawStraightLine(rect.getLeft(), rect.getTop(), rect.getRight(), rect.getTop(), colour);
-	drawStraightLine(rect.getLeft(), rect.getBottom(), rect.getRight(), rect.getBottom(), colour);
-	drawStraightLine(rect.getLeft(), rect.getTop(), rect.getLeft(), rect.getBottom(), colour);
-	drawStraightLine(rect.getRight(), rect.getTop(), rect.getRight(), rect.getBottom(), colour);
-}
-
-void CSdlDisplay::drawStraightLine(int x1, int y1, int x2, int y2, uint32_t pixel)
+uint32_t CSdlDisplay::getEdgeStrips(const CRect& rect, SDL_Rect* strips) const
 {
-	if (y1 > y2)
+	// The pixels drawRectEdge() sets: the horizontal lines stop short of
+	// right, the vertical ones include bottom. Clipped to the window.
+	const uint32_t left = rect.getLeft();
+	const uint32_t top = rect.getTop();
+	if (left >= _windowWidth || top >= _windowHeight)
 	{
-		int temp = y2;
-		y2 = y1;
-		y1 = temp;
+		return 0;
 	}
-	if (x1 > x2)
-	{
-		int temp = x2;
-		x2 = x1;
-		x1 = temp;
-	}
-	if (x1 == x2)
+	const uint32_t width = std::min(rect.getRight(), _windowWidth) - left;
+	const uint32_t height = std::min(rect.getBottom() + 1, _windowHeight) - top;
+
+	uint32_t numStrips = 0;
+	if (width > 0)
 	{
-		for (int y = y1; y < y2 + 1; y++)
+		strips[numStrips++] = SDL_Rect{ (Sint16) left, (Sint16) top, (Uint16) width, 1 };
+		if (rect.getBottom() < _windowHeight && rect.getBottom() != top)
 		{
-			setPixel(x1, y, pixel);
+			strips[numStrips++] = SDL_Rect{ (Sint16) left, (Sint16) rect.getBottom(), (Uint16) width, 1 };
 		}
 	}
-	else
+	strips[numStrips++] = SDL_Rect{ (Sint16) left, (Sint16) top, 1, (Uint16) height };
+	if (rect.getRight() < _windowWidth && rect.getRight() != left)
 	{
-		for (int x = x1; x < x2; x++)
-		{
-			setPixel(x, y1, pixel);
-		}
+		strips[numStrips++] = SDL_Rect{ (Sint16) rect.getRight(), (Sint16) top, 1, (Uint16) height };
 	}
+	return numStrips;
 }
 
-void CSdlDisplay::drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel)
+void CSdlDisplay::restoreStrips(const SDL_Rect* strips, uint32_t numStrips)
 {
-	int32_t dx = std::abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
-	int32_t dy = std::abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
-	int32_t err = (dx > dy ? dx : -dy) / 2, e2;
-
-	for (;;)
+	for (uint32_t i = 0; i < numStrips; i++)
 	{
-		setPixel(x1, y1, pixel);
-		if (x1 == x2 && y1 == y2)
-			break;
-		e2 = err;
-		if (e2 > -dx)
-		{
-			err -= dy;
-			x1 += sx;
-		}
-		if (e2 < dy)
+		const SDL_Rect& strip = strips[i];
+		for (int32_t y = strip.y; y < strip.y + strip.h; y++)
 		{
-			err += dx;
-			y1 += sy;
+			memcpy((uint8_t*) _screen->pixels + y * _screen->pitch + strip.x * 4, _treeMapImage + y * _windowWidth + strip.x, strip.w * 4);
 		}
 	}
 }
 
-void CSdlDisplay::swapBuffers()
+void CSdlDisplay::drawSelection()
 {
-	SDL_Flip(_screen);
-	SDL_FillRect(_screen, NULL, 0);
+	_numOutlineStrips = 0;
+	// Where the selection is in the frame on screen, the render thread
+	// may be laying out the items again meanwhile
+	const CTreeMap::LayoutRect* entry = _frame && _selectedNode != CSnapshot::NO_NODE ? _frame->treeMap.FindLayoutRect(_snapshot->getItem(_selectedNode)) : NULL;
+	if (entry)
+	{
+		_screenBuffer->drawRectEdge(entry->rc, 0xffffffff);
+		_numOutlineStrips = getEdgeStrips(entry->rc, _outlineStrips);
+	}
 }
 
-uint32_t* CSdlDisplay::getScreen() const
+void CSdlDisplay::showFrame(const CRenderThread::SFrame* frame)
 {
-	return static_cast<uint32_t*>(_screen->pixels);
+	_frame = frame;
+	_treeMapImage = frame->frameBuffer.getScreen();
+	// The metric is per thread, navigate in the order on screen
+	CSnapshot::SetUtilisationMetric(frame->metric);
+	for (uint32_t y = 0; y < _windowHeight; y++)
+	{
+		memcpy((uint8_t*) _screen->pixels + y * _screen->pitch, _treeMapImage + y * _windowWidth, _windowWidth * 4);
+	}
+	drawSelection();
+	swapBuffers();
 }
 
-void CSdlDisplay::run(CTreeMap* treemap, CFpgaItem* unusedItem)
+void CSdlDisplay::run(CRenderThread* renderThread, const CSnapshot* snapshot)
 {
 
-	_treeMap = treemap;
-	_unusedItem = unusedItem;
-	_itemToDraw = _unusedItem;
-	_selectedItem = _unusedItem;
-	CTreeMap::Options options = CTreeMap::GetDefaultOptions();
-
-	_unusedItem->recursivelyCalculateSize();
-	_unusedItem->sort();
+	_renderThread = renderThread;
+	_snapshot = snapshot;
+	_nodeToDraw = 0;
+	_selectedNode = 0;
 
 	_treeMapRedrawRequired = true;
 
 	while (1)
 	{
 		handleEvents();
+
+		// Drawn on the render thread, a newer request supersedes
+		// the one still being drawn
 		if (_treeMapRedrawRequired)
 		{
-			_treeMap->DrawTreemap(this, CRect(0, 0, getWidth(), getHeight()), _itemToDraw, &options);
-			memcpy(_treeMapImage, _screen->pixels, _windowHeight * _windowWidth * 4);
+			_renderThread->request(CRenderThread::SRequest{ _snapshot, _nodeToDraw, _metric, _options });
 			_treeMapRedrawRequired = false;
-			_selectedRedrawRequired = true;
 		}
-		else
+
+		if (_renderThread->isFrameReady())
 		{
-			if (_selectedRedrawRequired)
-			{
-				memcpy(_screen->pixels, _treeMapImage, _windowHeight * _windowWidth * 4);
-			}
+			const CRenderThread::SFrame* frame = _renderThread->acquireFrame();
+			showFrame(frame);
+			_selectedRedrawRequired = false;
+			showFrameTime(frame->renderMilliseconds);
+			continue;
 		}
-		if (_selectedRedrawRequired && _selectedItem)
+
+		if (!_selectedRedrawRequired)
 		{
-			drawRectEdge(_selectedItem->TmiGetRectangle(), 0xffffffff);
-			swapBuffers();
-			_selectedRedrawRequired = false;
+			continue;
 		}
-		struct timespec ts;
-		ts.tv_sec = 0;
-		ts.tv_nsec = 1000000000 / 60;
-		nanosleep(&ts, NULL);
+		_selectedRedrawRequired = false;
+		if (!_frame)
+		{
+			continue;
+		}
+
+		const std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		if (_damageTracking)
+		{
+			// Only the old and the new outline change, so only the
+			// strips under them are restored and sent
+			SDL_Rect damage[2 * MAX_OUTLINE_STRIPS];
+			uint32_t numDamaged = _numOutlineStrips;
+			std::copy(_outlineStrips, _outlineStrips + _numOutlineStrips, damage);
+			restoreStrips(_outlineStrips, _numOutlineStrips);
+			drawSelection();
+			std::copy(_outlineStrips, _outlineStrips + _numOutlineStrips, damage + numDamaged);
+			numDamaged += _numOutlineStrips;
+			SDL_UpdateRects(_screen, numDamaged, damage);
+		}
+		else
+		{
+			showFrame(_frame);
+		}
+		showFrameTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
 	}
 }
 
+void CSdlDisplay::showFrameTime(double milliseconds)
+{
+	// In the title bar, an idle viewer neither draws nor wakes up, so
+	// both counts stay put
+	_numFrames++;
+	char caption[128];
+	snprintf(caption, sizeof(caption), "%s - frame %u: %.1f ms, %u wakeups", CAPTION, _numFrames, milliseconds, _numWakeups);
+	SDL_WM_SetCaption(caption, CAPTION);
+}
+
 void CSdlDisplay::handleEvents()
 {
+	// Sleep until something happens unless there is a redraw pending, then
+	// take everything that queued up meanwhile so it is drawn only once
+	if (!_treeMapRedrawRequired && !_selectedRedrawRequired && !_renderThread->isFrameReady())
+	{
+		waitEvent();
+		handleEvent();
+	}
 	while (SDL_PollEvent(&_event))
 	{
-		switch (_event.type)
+		handleEvent();
+	}
+}
+
+void CSdlDisplay::waitEvent()
+{
+	if (_eventFd < 0)
+	{
+		_numWakeups++;
+		if (SDL_WaitEvent(&_event) == 0)
 		{
-			case SDL_MOUSEMOTION:
-			{
-				//printf("Mouse moved by %d,%d to (%d,%d)\n", _event.motion.xrel, _event.motion.yrel,	_event.motion.x, _event.motion.y);
-				break;
-			}
-			case SDL_MOUSEBUTTONDOWN:
+			fprintf(stderr, "Could not wait for SDL events: %s\n", SDL_GetError());
+			exit(1);
+		}
+		return;
+	}
+
+	// Pumping reads everything Xlib has, so anything newer is still on
+	// the connection and wakes us. wake() pushes its event before it
+	// writes the pipe, so the event is there once we see the byte.
+	while (!SDL_PollEvent(&_event))
+	{
+		struct pollfd fds[2] = { { _eventFd, POLLIN, 0 }, { _wakePipe[0], POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0 && errno != EINTR)
+		{
+			fprintf(stderr, "Could not wait for X events: %s\n", strerror(errno));
+			exit(1);
+		}
+		uint8_t bytes[64];
+		while (read(_wakePipe[0], bytes, sizeof(bytes)) > 0)
+		{
+		}
+		_numWakeups++;
+	}
+}
+
+void CSdlDisplay::handleEvent()
+{
+	switch (_event.type)
+	{
+		case SDL_MOUSEMOTION:
+		{
+			//printf("Mouse moved by %d,%d to (%d,%d)\n", _event.motion.xrel, _event.motion.yrel,	_event.motion.x, _event.motion.y);
+			break;
+		}
+		case SDL_MOUSEBUTTONDOWN:
+		{
+			//printf("Mouse button %d pressed at (%d,%d)\n", _event.button.button, _event.button.x, _event.button.y);
+			// What the user sees, not what is being drawn
+			if (_frame)
 			{
-				//printf("Mouse button %d pressed at (%d,%d)\n", _event.button.button, _event.button.x, _event.button.y);
-				if (_treeMap && _itemToDraw)
+				const CSnapshot::Item* item = dynamic_cast<const CSnapshot::Item*>(_frame->treeMap.GetItemAt(CPoint(_event.button.x, _event.button.y)));
+				if (item)
 				{
-					CFpgaItem* item = dynamic_cast<CFpgaItem*>(_treeMap->FindItemByPoint(_itemToDraw, CPoint(_event.button.x, _event.button.y)));
-					if (item)
-					{
-						_selectedItem = item;
-						_selectedItem->printHeirachy();
-						_selectedRedrawRequired = true;
-					}
+					_selectedNode = item->getNode();
+					_snapshot->printHierarchy(_selectedNode);
+					_selectedRedrawRequired = true;
 				}
-				break;
 			}
-			case SDL_KEYDOWN:
+			break;
+		}
+		case SDL_KEYDOWN:
+		{
+			switch (_event.key.keysym.sym)
 			{
-				switch (_event.key.keysym.sym)
+				case SDLK_d:
 				{
-					case SDLK_d:
-					{
-						CFpgaItem::SetUtilisationMetric(EUtilisationMetric::DSP);
-						_unusedItem->recursivelyCalculateSize();
-						_unusedItem->sort();
-						_treeMapRedrawRequired = true;
-						break;
-					}
-					case SDLK_r:
-					{
-						CFpgaItem::SetUtilisationMetric(EUtilisationMetric::RAM);
-						_unusedItem->recursivelyCalculateSize();
-						_unusedItem->sort();
-						_treeMapRedrawRequired = true;
-						break;
-					}
-					case SDLK_l:
-					{
-						CFpgaItem::SetUtilisationMetric(EUtilisationMetric::LUT);
-						_unusedItem->recursivelyCalculateSize();
-						_unusedItem->sort();
-						_treeMapRedrawRequired = true;
-						break;
-					}
-					case SDLK_s:
+					_metric = EUtilisationMetric::DSP;
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_r:
+				{
+					_metric = EUtilisationMetric::RAM;
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_l:
+				{
+					_metric = EUtilisationMetric::LUT;
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_s:
+				{
+					_metric = EUtilisationMetric::SLICE;
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_f:
+				{
+					_metric = EUtilisationMetric::REG;
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_a:
+				{
+					_options.lodArea = _options.lodArea ? 0 : LOD_AREA;
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_u:
+				{
+					if(_nodeToDraw == 0 && _snapshot->getFirstChild(0) != CSnapshot::NO_NODE)
 					{
-						CFpgaItem::SetUtilisationMetric(EUtilisationMetric::SLICE);
-						_unusedItem->recursivelyCalculateSize();
-						_unusedItem->sort();
-						_treeMapRedrawRequired = true;
-						break;
+						_nodeToDraw = _snapshot->getFirstChild(0);
 					}
-					case SDLK_f:
+					else
 					{
-						CFpgaItem::SetUtilisationMetric(EUtilisationMetric::REG);
-						_unusedItem->recursivelyCalculateSize();
-						_unusedItem->sort();
-						_treeMapRedrawRequired = true;
-						break;
+						_nodeToDraw = 0;
 					}
-					case SDLK_u:
+					_treeMapRedrawRequired = true;
+					break;
+				}
+				case SDLK_LEFT:
+				{
+					// select parent
+					if (_selectedNode != CSnapshot::NO_NODE && _snapshot->getParent(_selectedNode) != CSnapshot::NO_NODE)
 					{
-						if(_itemToDraw == _unusedItem)
-						{
-							_itemToDraw = _unusedItem->getChild(0);
-						}
-						else
-						{
-							_itemToDraw = _unusedItem;
-						}
-						_treeMapRedrawRequired = true;
-						break;
+						_selectedNode = _snapshot->getParent(_selectedNode);
+						_snapshot->printHierarchy(_selectedNode);
+						_selectedRedrawRequired = true;
 					}
-					case SDLK_LEFT:
+					break;
+				}
+				case SDLK_DOWN:
+				{
+					// select next sibling, or parent's next child
+					if (_selectedNode != CSnapshot::NO_NODE)
 					{
-						// select parent
-						if (_selectedItem && _selectedItem->getParent())
+						uint32_t node = _snapshot->getNextSibling(_selectedNode);
+						if (node != CSnapshot::NO_NODE)
 						{
-							CFpgaItem* item = _selectedItem->getParent();
-							if (item)
-							{
-								_selectedItem = item;
-								_selectedItem->printHeirachy();
-							}
-							_selectedRedrawRequired = true;
+							_selectedNode = node;
+							_snapshot->printHierarchy(_selectedNode);
 						}
-						break;
+						_selectedRedrawRequired = true;
 					}
-					case SDLK_DOWN:
+					break;
+				}
+				case SDLK_UP:
+				{
+					// select previous sibling, of parent when first sibling
+					if (_selectedNode != CSnapshot::NO_NODE)
 					{
-						// select next sibling, or parent's next child
-						if (_selectedItem)
+						uint32_t node = _snapshot->getPreviousSibling(_selectedNode);
+						if (node != CSnapshot::NO_NODE)
 						{
-							CFpgaItem* item = _selectedItem->getNextSibling();
-							if (item)
-							{
-								_selectedItem = item;
-								_selectedItem->printHeirachy();
-							}
-							_selectedRedrawRequired = true;
+							_selectedNode = node;
+							_snapshot->printHierarchy(_selectedNode);
 						}
-						break;
+						_selectedRedrawRequired = true;
 					}
-					case SDLK_UP:
+					break;
+				}
+				case SDLK_RIGHT:
+				{
+					// select first child
+					if (_selectedNode != CSnapshot::NO_NODE)
 					{
-						// select previous sibling, of parent when first sibling
-						if (_selectedItem)
+						uint32_t node = _snapshot->getFirstChild(_selectedNode);
+						if (node != CSnapshot::NO_NODE)
 						{
-							CFpgaItem* item = _selectedItem->getPreviousSibling();
-							if (item)
-							{
-								_selectedItem = item;
-								_selectedItem->printHeirachy();
-							}
+							_selectedNode = node;
+							_snapshot->printHierarchy(_selectedNode);
 							_selectedRedrawRequired = true;
 						}
-						break;
-					}
-					case SDLK_RIGHT:
-					{
-						// select first child
-						if (_selectedItem)
-						{
-							if (_selectedItem->TmiGetChildrenCount() > 0)
-							{
-								_selectedItem = _selectedItem->getChild(0);
-								_selectedItem->printHeirachy();
-								_selectedRedrawRequired = true;
-							}
-						}
-						break;
 					}
+					break;
 				}
-				break;
 			}
-			case SDL_QUIT:
+			break;
+		}
+		case SDL_USEREVENT:
+		{
+			// From wake(), the loop checks for a new frame anyway
+			break;
+		}
+		case SDL_VIDEOEXPOSE:
+		{
+			// The screen still holds the last frame unless it is double buffered
+			if (_damageTracking)
+			{
+				swapBuffers();
+			}
+			else
 			{
-				exit(0);
+				_selectedRedrawRequired = true;
 			}
+			break;
+		}
+		case SDL_QUIT:
+		{
+			exit(0);
 		}
 	}
 }
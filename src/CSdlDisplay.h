@@ -5,9 +5,13 @@
 #include <thread>
 #include <mutex>
 
+#include "CFrameBuffer.h"
+#include "CRenderThread.h"
+#include "EUtilisationMetric.h"
+#include "windirstat/CTreeMap.h"
+
 class CRect;
-class CTreeMap;
-class CFpgaItem;
+class CSnapshot;
 
 class CSdlDisplay
 {
@@ -18,35 +22,68 @@ public:
 	uint32_t    getWidth             () const;
 	uint32_t    getHeight            () const;
 
-	void        setPixel             (int32_t x, int32_t y, uint32_t pixel);
-	void        drawStraightLine     (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel);
-	void        drawLine             (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t pixel);
-	uint32_t    setColour            (uint8_t r, uint8_t g, uint8_t b);
-
-	void        fillSolidRect        (const CRect& rect, uint32_t colour);
-	void        drawRectEdge         (const CRect& rect, uint32_t colour);
-
 	void        swapBuffers          ();
 
-	uint32_t*   getScreen            () const;
-	void        run                  (CTreeMap* treemap, CFpgaItem* unusedItem);
+	// Wakes the event loop, safe to call from any thread
+	void        wake                 ();
+	void        run                  (CRenderThread* renderThread, const CSnapshot* snapshot);
 
 private:
 
-	uint8_t* _treeMapImage;
+	// The frame on screen, without the selection outline
+	const CRenderThread::SFrame* _frame;
+	const uint32_t* _treeMapImage;
 	SDL_Surface* _screen;
-	CTreeMap* _treeMap;
-	CFpgaItem* _unusedItem;
-	CFpgaItem* _selectedItem;
-	CFpgaItem* _itemToDraw;
+	// Draws on _screen
+	CFrameBuffer* _screenBuffer;
+	CRenderThread* _renderThread;
+	EUtilisationMetric _metric;
+	CTreeMap::Options _options;
+	// lodArea while level of detail is switched on with 'a'
+	static const uint32_t LOD_AREA = 16;
+	// nodes of _snapshot, the root is [UNUSED RESOURCES]
+	const CSnapshot* _snapshot;
+	uint32_t _selectedNode;
+	uint32_t _nodeToDraw;
 	bool _treeMapRedrawRequired;
 	bool _selectedRedrawRequired;
 
+	// Screen areas under the selection outline currently drawn
+	static const uint32_t MAX_OUTLINE_STRIPS = 4;
+	SDL_Rect _outlineStrips[MAX_OUTLINE_STRIPS];
+	uint32_t _numOutlineStrips;
+	bool _damageTracking;
+
+	// Frames drawn and returns from waiting for events
+	uint32_t _numFrames;
+	uint32_t _numWakeups;
+
+	// The X connection, -1 if SDL_WaitEvent() has to do
+	int _eventFd;
+	// Written by wake() so a poll() on _eventFd returns too
+	int _wakePipe[2];
+
 	SDL_Event _event;
 	uint32_t _windowWidth;
 	uint32_t _windowHeight;
 
+	static const char* const CAPTION;
+
+	// Blocks for the next event unless a redraw is pending, then
+	// handles everything that is queued
 	void handleEvents();
+	void waitEvent();
+	void handleEvent();
+	void showFrameTime(double milliseconds);
+
+	// The strips of the screen drawRectEdge() draws on for rect
+	uint32_t getEdgeStrips(const CRect& rect, SDL_Rect* strips) const;
+	// Copies the strips back from the treemap image
+	void restoreStrips(const SDL_Rect* strips, uint32_t numStrips);
+	// Outlines the selected item and remembers where
+	void drawSelection();
+	// Puts a finished frame from the render thread on the screen
+	void showFrame(const CRenderThread::SFrame* frame);
 
 };
 
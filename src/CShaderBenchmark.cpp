@@ -0,0 +1,292 @@
+#include "CShaderBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "windirstat/CColorSpace.h"
+#include "windirstat/CTreeMap.h"
+
+static const uint32_t SEED = 12345;
+static const uint32_t NUM_IMPLEMENTATIONS = 3;
+static const uint32_t NUM_MODES = 3;
+static const char* const IMPLEMENTATION_NAMES[NUM_IMPLEMENTATIONS] = { "scalar", "sse4.1", "avx2" };
+static const char* const MODE_NAMES[NUM_MODES] = { "per-pixel", "separable", "lookup" };
+
+// Same as the default options, see CTreeMap
+static const double PALETTE_BRIGHTNESS = 0.6;
+static const double HEIGHT = 0.38;
+static const double SCALE_FACTOR = 0.91;
+
+// Each timing runs for at least this long
+static const double MIN_MILLISECONDS = 200;
+
+// The lighting and colour of a frame drawn with options
+static void useOptions(const CTreeMap::Options& options, uint32_t colour, CCushionShader::SParameters& parameters)
+{
+	parameters.ambientLight = options.ambientLight;
+	parameters.brightness = options.brightness / PALETTE_BRIGHTNESS;
+	parameters.colour = colour;
+}
+
+CShaderBenchmark::CShaderBenchmark() :
+		_random(SEED),
+		_reference(SCREEN_SIZE * SCREEN_SIZE)
+{
+
+}
+
+CShaderBenchmark::~CShaderBenchmark()
+{
+
+}
+
+void CShaderBenchmark::createCushion(int32_t left, int32_t top, int32_t right, int32_t bottom, SCushion& cushion)
+{
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	cushion.left = left;
+	cushion.top = top;
+	cushion.right = right;
+	cushion.bottom = bottom;
+
+	// Ancestors grow outwards from the cushion, the ridges are added from
+	// the outermost in with the height scaled down at every level
+	const uint32_t depth = _random() % 10;
+	std::vector<int32_t> rects(4 * (depth + 1));
+	rects[0] = left;
+	rects[1] = top;
+	rects[2] = right;
+	rects[3] = bottom;
+	for (uint32_t d = 1; d <= depth; d++)
+	{
+		const int32_t* inner = &rects[4 * (d - 1)];
+		int32_t* outer = &rects[4 * d];
+		outer[0] = std::max(0, inner[0] - (int32_t) (_random() % 64));
+		outer[1] = std::max(0, inner[1] - (int32_t) (_random() % 64));
+		outer[2] = std::min(SCREEN_SIZE, inner[2] + (int32_t) (_random() % 64));
+		outer[3] = std::min(SCREEN_SIZE, inner[3] + (int32_t) (_random() % 64));
+	}
+
+	CCushionShader::SParameters& p = cushion.parameters;
+	for (int i = 0; i < 4; i++)
+	{
+		p.surface[i] = 0;
+	}
+	double h = HEIGHT;
+	for (int32_t d = depth; d >= 0; d--)
+	{
+		// CTreeMap::AddRidge()
+		const int32_t* rc = &rects[4 * d];
+		const double wf = 4 * h / (rc[2] - rc[0]);
+		p.surface[2] += wf * (rc[2] + rc[0]);
+		p.surface[0] -= wf;
+		const double hf = 4 * h / (rc[3] - rc[1]);
+		p.surface[3] += hf * (rc[3] + rc[1]);
+		p.surface[1] -= hf;
+		h *= SCALE_FACTOR;
+	}
+
+	// CTreeMap::SetOptions() with the light anywhere in its range
+	const double lx = 8 * unit(_random) - 4;
+	const double ly = 8 * unit(_random) - 4;
+	const double lz = 10;
+	const double length = sqrt(lx * lx + ly * ly + lz * lz);
+	p.lx = lx / length;
+	p.ly = ly / length;
+	p.lz = lz / length;
+	p.ambientLight = 0.5 * unit(_random);
+	// CTreeMap::RenderRectangle() makes some colours darker or brighter
+	const double brightness = 0.5 + 0.5 * unit(_random);
+	const double flags[] = { 1.0, 0.66, 1.2 };
+	p.brightness = std::min(1.0, brightness * flags[_random() % 3]) / PALETTE_BRIGHTNESS;
+	// as bright as the palette, or the colour could overflow
+	p.colour = CColorSpace::MakeBrightColor(_random() & 0xffffff, PALETTE_BRIGHTNESS);
+}
+
+int32_t CShaderBenchmark::getMaxError(const SCushion& cushion, const std::vector<uint32_t>& screen) const
+{
+	int32_t maxError = 0;
+	for (int32_t y = cushion.top; y < cushion.bottom; y++)
+	{
+		for (int32_t x = cushion.left; x < cushion.right; x++)
+		{
+			const uint32_t pixel = screen[y * SCREEN_SIZE + x];
+			const uint32_t reference = _reference[y * SCREEN_SIZE + x];
+			for (uint32_t shift = 0; shift < 24; shift += 8)
+			{
+				const int32_t error = std::abs((int32_t) ((pixel >> shift) & 0xff) - (int32_t) ((reference >> shift) & 0xff));
+				maxError = std::max(maxError, error);
+			}
+		}
+	}
+	return maxError;
+}
+
+bool CShaderBenchmark::check(uint32_t numCushions)
+{
+	const CCushionShader::EImplementation implementation = CCushionShader::getImplementation();
+	const CCushionShader::EMode mode = CCushionShader::getMode();
+
+	std::vector<uint32_t> whole(SCREEN_SIZE * SCREEN_SIZE);
+	std::vector<uint32_t> parts(SCREEN_SIZE * SCREEN_SIZE);
+
+	// shadeRow() kernels, then shadeRect() in every implementation and mode
+	int32_t rowErrors[NUM_IMPLEMENTATIONS] = { 0 };
+	int32_t rectErrors[NUM_IMPLEMENTATIONS][NUM_MODES] = { { 0 } };
+	uint32_t clipFailures[NUM_IMPLEMENTATIONS][NUM_MODES] = { { 0 } };
+	uint64_t numPixels = 0;
+
+	const CCushionShader::EImplementation implementations[NUM_IMPLEMENTATIONS] = { CCushionShader::EImplementation::SCALAR, CCushionShader::EImplementation::SSE41, CCushionShader::EImplementation::AVX2 };
+	void (*const shadeRows[NUM_IMPLEMENTATIONS])(const CCushionShader::SParameters&, int32_t, int32_t, int32_t, int32_t, uint32_t*) = { &CCushionShader::shadeRowScalar, &CCushionShader::shadeRowSse41, &CCushionShader::shadeRowAvx2 };
+
+	for (uint32_t c = 0; c < numCushions; c++)
+	{
+		// mostly leaf sized, some large
+		const int32_t maxSize = c % 8 == 0 ? SCREEN_SIZE : 64;
+		const int32_t width = 1 + _random() % maxSize;
+		const int32_t height = 1 + _random() % maxSize;
+		const int32_t left = _random() % (SCREEN_SIZE - width + 1);
+		const int32_t top = _random() % (SCREEN_SIZE - height + 1);
+		SCushion cushion;
+		createCushion(left, top, left + width, top + height, cushion);
+		const CCushionShader::SParameters& p = cushion.parameters;
+		numPixels += width * height;
+
+		for (int32_t y = cushion.top; y < cushion.bottom; y++)
+		{
+			CCushionShader::shadeRowScalar(p, y, left, left, cushion.right, &_reference[y * SCREEN_SIZE]);
+		}
+
+		// where the clipped parts meet
+		const int32_t splitX = left + _random() % width;
+		const int32_t splitY = top + _random() % height;
+
+		for (uint32_t i = 0; i < NUM_IMPLEMENTATIONS; i++)
+		{
+			if (!CCushionShader::setImplementation(implementations[i]))
+			{
+				continue;
+			}
+
+			for (int32_t y = cushion.top; y < cushion.bottom; y++)
+			{
+				shadeRows[i](p, y, left, left, cushion.right, &whole[y * SCREEN_SIZE]);
+			}
+			rowErrors[i] = std::max(rowErrors[i], getMaxError(cushion, whole));
+
+			for (uint32_t m = 0; m < NUM_MODES; m++)
+			{
+				CCushionShader::setMode(static_cast<CCushionShader::EMode>(m));
+				CCushionShader::shadeRect(p, left, top, cushion.right, cushion.bottom, whole.data(), SCREEN_SIZE);
+				rectErrors[i][m] = std::max(rectErrors[i][m], getMaxError(cushion, whole));
+
+				CCushionShader::shadeRect(p, left, top, cushion.right, cushion.bottom, left, top, splitX, splitY, parts.data(), SCREEN_SIZE);
+				CCushionShader::shadeRect(p, left, top, cushion.right, cushion.bottom, splitX, top, cushion.right, splitY, parts.data(), SCREEN_SIZE);
+				CCushionShader::shadeRect(p, left, top, cushion.right, cushion.bottom, left, splitY, splitX, cushion.bottom, parts.data(), SCREEN_SIZE);
+				CCushionShader::shadeRect(p, left, top, cushion.right, cushion.bottom, splitX, splitY, cushion.right, cushion.bottom, parts.data(), SCREEN_SIZE);
+				for (int32_t y = cushion.top; y < cushion.bottom; y++)
+				{
+					if (!std::equal(&whole[y * SCREEN_SIZE + left], &whole[y * SCREEN_SIZE + cushion.right], &parts[y * SCREEN_SIZE + left]))
+					{
+						clipFailures[i][m]++;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	CCushionShader::setImplementation(implementation);
+	CCushionShader::setMode(mode);
+
+	printf("%u cushions, %llu pixels, largest channel error against the scalar reference\n", numCushions, (unsigned long long) numPixels);
+	bool passed = true;
+	for (uint32_t i = 0; i < NUM_IMPLEMENTATIONS; i++)
+	{
+		if (!CCushionShader::isSupported(implementations[i]))
+		{
+			printf("  %-7s not supported by this CPU\n", IMPLEMENTATION_NAMES[i]);
+			continue;
+		}
+
+		const bool rowPassed = rowErrors[i] <= CCushionShader::MAX_CHANNEL_ERROR;
+		printf("  %-7s shadeRow   %d%s\n", IMPLEMENTATION_NAMES[i], rowErrors[i], rowPassed ? "" : "  FAILED");
+		passed &= rowPassed;
+
+		for (uint32_t m = 0; m < NUM_MODES; m++)
+		{
+			const int32_t maxError = static_cast<CCushionShader::EMode>(m) == CCushionShader::EMode::LOOKUP ? CCushionShader::MAX_LOOKUP_CHANNEL_ERROR : CCushionShader::MAX_CHANNEL_ERROR;
+			const bool rectPassed = rectErrors[i][m] <= maxError && clipFailures[i][m] == 0;
+			printf("  %-7s %-10s %d (bound %d), %u clipped cushions differ%s\n", IMPLEMENTATION_NAMES[i], MODE_NAMES[m], rectErrors[i][m], maxError, clipFailures[i][m], rectPassed ? "" : "  FAILED");
+			passed &= rectPassed;
+		}
+	}
+	return passed;
+}
+
+double CShaderBenchmark::time(const std::vector<SCushion>& cushions)
+{
+	std::vector<uint32_t> screen(SCREEN_SIZE * SCREEN_SIZE);
+	uint64_t numPixels = 0;
+	double milliseconds = 0;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (milliseconds < MIN_MILLISECONDS)
+	{
+		for (const SCushion& cushion : cushions)
+		{
+			CCushionShader::shadeRect(cushion.parameters, cushion.left, cushion.top, cushion.right, cushion.bottom, screen.data(), SCREEN_SIZE);
+			numPixels += (cushion.right - cushion.left) * (cushion.bottom - cushion.top);
+		}
+		milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	return numPixels / milliseconds / 1000;
+}
+
+void CShaderBenchmark::run()
+{
+	const CCushionShader::EImplementation implementation = CCushionShader::getImplementation();
+	const CCushionShader::EMode mode = CCushionShader::getMode();
+
+	// A window sized cushion, and the same area in 30 pixel leaves. Like
+	// a frame they share the default options and palette, which is what
+	// the LOOKUP tables are cached for.
+	const CTreeMap::Options options = CTreeMap::GetDefaultOptions();
+	std::vector<uint32_t> palette;
+	CTreeMap::GetDefaultPalette(palette);
+
+	std::vector<SCushion> large(1);
+	createCushion(0, 0, 900, 900, large[0]);
+	useOptions(options, palette[0], large[0].parameters);
+	std::vector<SCushion> leaves(30 * 30);
+	for (uint32_t i = 0; i < leaves.size(); i++)
+	{
+		const int32_t left = (i % 30) * 30;
+		const int32_t top = (i / 30) * 30;
+		createCushion(left, top, left + 30, top + 30, leaves[i]);
+		useOptions(options, palette[i % palette.size()], leaves[i].parameters);
+	}
+
+	printf("Mpixel/s, one thread    900x900    30x30 leaves\n");
+	const CCushionShader::EImplementation implementations[NUM_IMPLEMENTATIONS] = { CCushionShader::EImplementation::SCALAR, CCushionShader::EImplementation::SSE41, CCushionShader::EImplementation::AVX2 };
+	for (uint32_t i = 0; i < NUM_IMPLEMENTATIONS; i++)
+	{
+		if (!CCushionShader::setImplementation(implementations[i]))
+		{
+			continue;
+		}
+		for (uint32_t m = 0; m < NUM_MODES; m++)
+		{
+			CCushionShader::setMode(static_cast<CCushionShader::EMode>(m));
+			const double largeRate = time(large);
+			const double leavesRate = time(leaves);
+			printf("  %-7s %-10s %10.1f %15.1f\n", IMPLEMENTATION_NAMES[i], MODE_NAMES[m], largeRate, leavesRate);
+		}
+	}
+
+	CCushionShader::setImplementation(implementation);
+	CCushionShader::setMode(mode);
+}
@@ -0,0 +1,47 @@
+#ifndef SRC_CSHADERBENCHMARK_H_
+#define SRC_CSHADERBENCHMARK_H_
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "CCushionShader.h"
+
+// Checks every CCushionShader implementation and mode against the scalar
+// reference on random cushions, then times them. Fails if a channel is off
+// by more than the shader's error bound, or if shading a cushion in clipped
+// parts gives different pixels to shading it whole.
+class CShaderBenchmark
+{
+public:
+	CShaderBenchmark();
+	~CShaderBenchmark();
+
+	bool check(uint32_t numCushions);
+	void run();
+
+private:
+	struct SCushion
+	{
+		CCushionShader::SParameters parameters;
+		int32_t left;
+		int32_t top;
+		int32_t right;
+		int32_t bottom;
+	};
+
+	static const int32_t SCREEN_SIZE = 1024;
+
+	// Nested ridges down to [left, right) x [top, bottom) as CTreeMap builds
+	// them, with random lighting and colour
+	void createCushion(int32_t left, int32_t top, int32_t right, int32_t bottom, SCushion& cushion);
+	// largest difference of any channel inside the cushion
+	int32_t getMaxError(const SCushion& cushion, const std::vector<uint32_t>& screen) const;
+	// Mpixel/s of shadeRect() over all the cushions
+	double time(const std::vector<SCushion>& cushions);
+
+	std::mt19937 _random;
+	std::vector<uint32_t> _reference;
+};
+
+#endif /* SRC_CSHADERBENCHMARK_H_ */
@@ -0,0 +1,459 @@
+#include "CSnapshot.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "CFpgaItem.h"
+
+static const char SNAPSHOT_MAGIC[8] = { 'F', 'P', 'G', 'A', 'T', 'M', 'A', 'P' };
+
+thread_local EUtilisationMetric CSnapshot::_UtilisationMetric = EUtilisationMetric::REG;
+
+CSnapshot::Item::Item(const CSnapshot* snapshot, uint32_t node) :
+		_snapshot(snapshot),
+		_node(node)
+{
+
+}
+
+uint32_t CSnapshot::Item::getNode() const
+{
+	return _node;
+}
+
+bool CSnapshot::Item::TmiIsLeaf() const
+{
+	return _snapshot->getNumVisibleChildren(_node, _UtilisationMetric) == 0;
+}
+
+uint32_t CSnapshot::Item::TmiGetGraphColor() const
+{
+	return _snapshot->getColour(_node);
+}
+
+int CSnapshot::Item::TmiGetChildrenCount() const
+{
+	return _snapshot->getNumVisibleChildren(_node, _UtilisationMetric);
+}
+
+CTreeMap::Item* CSnapshot::Item::TmiGetChild(int c) const
+{
+	return const_cast<Item*>(_snapshot->getItem(_snapshot->getChild(_node, c, _UtilisationMetric)));
+}
+
+uint64_t CSnapshot::Item::TmiGetLocalSize() const
+{
+	return _snapshot->getLocalSize(_node, _UtilisationMetric);
+}
+
+uint64_t CSnapshot::Item::TmiGetRecursiveSize() const
+{
+	return _snapshot->getRecursiveSize(_node, _UtilisationMetric);
+}
+
+CSnapshot::CSnapshot(const char* mapReport) :
+		_mapReport(mapReport),
+		_filename(std::string(mapReport) + ".snapshot"),
+		_header(NULL),
+		_nodes(NULL),
+		_childLists(NULL),
+		_strings(NULL),
+		_rootItem(NULL)
+{
+
+}
+
+CSnapshot::~CSnapshot()
+{
+
+}
+
+bool CSnapshot::load()
+{
+	struct stat st;
+	if (stat(_filename.c_str(), &st) != 0)
+	{
+		// no snapshot yet
+		return false;
+	}
+	if (!_snapshot.open(_filename.c_str()))
+	{
+		return false;
+	}
+
+	const char* data = _snapshot.getData();
+	const uint64_t size = _snapshot.getSize();
+	const SHeader* header = reinterpret_cast<const SHeader*>(data);
+
+	if (size < sizeof(SHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header->version != VERSION)
+	{
+		fprintf(stderr, "Ignoring snapshot %s: unknown format\n", _filename.c_str());
+		_snapshot.close();
+		return false;
+	}
+	// The nodes themselves are trusted, save() is the only writer and it
+	// renames complete files into place. Checking them would mean reading
+	// all of them before the first frame.
+	const uint64_t numSlots = header->numNodes ? header->numNodes - 1 : 0;
+	if (header->numNodes == 0 || header->nodesOffset % alignof(SNode) != 0 || header->childListsOffset % alignof(uint32_t) != 0 ||
+			header->nodesOffset + header->numNodes * sizeof(SNode) > size ||
+			header->childListsOffset + NUM_UTILISATION_METRICS * numSlots * sizeof(uint32_t) > size ||
+			header->stringTableOffset + header->stringTableSize > size)
+	{
+		fprintf(stderr, "Ignoring snapshot %s: truncated\n", _filename.c_str());
+		_snapshot.close();
+		return false;
+	}
+
+	SReportKey key;
+	if (!readReportKey(key) || memcmp(&key, &header->report, sizeof(key)) != 0)
+	{
+		// stale, the report has been rewritten since
+		_snapshot.close();
+		return false;
+	}
+
+	attach(data);
+	return true;
+}
+
+void CSnapshot::create(CFpgaItem* items, const CResourceUtilisation& used, const CResourceUtilisation& total)
+{
+	// preorder, each item with its parent's node
+	std::vector<std::pair<CFpgaItem*, uint32_t>> order;
+	std::vector<std::pair<CFpgaItem*, uint32_t>> stack;
+	stack.push_back(std::make_pair(items, NO_NODE));
+	while (!stack.empty())
+	{
+		std::pair<CFpgaItem*, uint32_t> entry = stack.back();
+		stack.pop_back();
+		uint32_t node = order.size();
+		order.push_back(entry);
+		for (uint32_t c = entry.first->getNumChildren(); c > 0; c--)
+		{
+			stack.push_back(std::make_pair(entry.first->getChildByIndex(c - 1), node));
+		}
+	}
+	const uint32_t numNodes = order.size();
+	const uint64_t numSlots = numNodes - 1;
+
+	// CTreeMapBuilder interns the names, so equal names share their data
+	// and the string table holds each once
+	std::string strings;
+	std::unordered_map<const char*, std::pair<uint32_t, uint32_t>> stringOffsets;
+	std::vector<uint32_t> nameOffsets(numNodes);
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		const CStringSpan& name = order[node].first->getName();
+		auto offset = stringOffsets.find(name.getData());
+		if (offset == stringOffsets.end() || offset->second.second < name.getLength())
+		{
+			offset = stringOffsets.insert(std::make_pair(name.getData(), std::make_pair(0u, 0u))).first;
+			offset->second = std::make_pair((uint32_t) strings.size(), name.getLength());
+			strings.append(name.getData(), name.getLength());
+		}
+		nameOffsets[node] = offset->second.first;
+	}
+
+	SHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = VERSION;
+	header.numNodes = numNodes;
+	// a report we can't stat gets a key no later run will match
+	readReportKey(header.report);
+	packUtilisation(used, header.used);
+	packUtilisation(total, header.total);
+	header.nodesOffset = sizeof(SHeader);
+	header.childListsOffset = header.nodesOffset + numNodes * sizeof(SNode);
+	header.stringTableOffset = header.childListsOffset + NUM_UTILISATION_METRICS * numSlots * sizeof(uint32_t);
+	header.stringTableSize = strings.size();
+
+	_image.assign(header.stringTableOffset + header.stringTableSize, 0);
+	memcpy(_image.data(), &header, sizeof(header));
+	memcpy(_image.data() + header.stringTableOffset, strings.data(), strings.size());
+	SNode* nodes = reinterpret_cast<SNode*>(_image.data() + header.nodesOffset);
+	uint32_t* childLists = reinterpret_cast<uint32_t*>(_image.data() + header.childListsOffset);
+
+	// The sizes and orders are the ones finish() left in the items. Parents
+	// come first, so each item can put itself in their child lists.
+	uint32_t firstChild = 0;
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		CFpgaItem* item = order[node].first;
+		const uint32_t parent = order[node].second;
+		SNode& n = nodes[node];
+		n.nameOffset = nameOffsets[node];
+		n.nameLength = item->getName().getLength();
+		n.parent = parent;
+		n.colour = item->getColour();
+		n.firstChild = firstChild;
+		n.numChildren = item->getNumChildren();
+		firstChild += n.numChildren;
+
+		for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+		{
+			const EUtilisationMetric metric = static_cast<EUtilisationMetric>(m);
+			n.utilisation[m] = item->getResourceUtilisation().get(metric);
+			n.recursiveSizes[m] = item->getRecursiveSize(metric);
+			n.numVisibleChildren[m] = item->getNumVisibleChildren(metric);
+			const uint32_t index = item->getSortedIndex(metric);
+			if (parent != NO_NODE && index != CFpgaItem::NOT_SORTED)
+			{
+				childLists[m * numSlots + nodes[parent].firstChild + index] = node;
+			}
+		}
+	}
+
+	attach(_image.data());
+}
+
+bool CSnapshot::save()
+{
+	if (_image.empty())
+	{
+		fprintf(stderr, "%s::%s nothing to write to %s\n", __FILE__, __FUNCTION__, _filename.c_str());
+		return false;
+	}
+
+	// write to a temporary file and rename so readers never see half a snapshot
+	std::string tmpFilename = _filename + ".tmp";
+	FILE* fh = fopen(tmpFilename.c_str(), "wb");
+	if (!fh)
+	{
+		fprintf(stderr, "%s::%s unable to write snapshot %s: %s\n", __FILE__, __FUNCTION__, tmpFilename.c_str(), strerror(errno));
+		return false;
+	}
+
+	bool ok = fwrite(_image.data(), 1, _image.size(), fh) == _image.size();
+	ok = (fclose(fh) == 0) && ok;
+
+	if (!ok || rename(tmpFilename.c_str(), _filename.c_str()) != 0)
+	{
+		fprintf(stderr, "%s::%s unable to write snapshot %s: %s\n", __FILE__, __FUNCTION__, _filename.c_str(), strerror(errno));
+		remove(tmpFilename.c_str());
+		return false;
+	}
+	return true;
+}
+
+const CResourceUtilisation& CSnapshot::getUsed() const
+{
+	return _used;
+}
+
+const CResourceUtilisation& CSnapshot::getTotal() const
+{
+	return _total;
+}
+
+CFpgaItem* CSnapshot::createItems()
+{
+	if (_rootItem)
+	{
+		return _rootItem;
+	}
+
+	const uint32_t numNodes = _header->numNodes;
+	std::vector<CFpgaItem*> items(numNodes, NULL);
+	_builder.reserve(numNodes);
+	for (uint32_t node = 0; node < numNodes; node++)
+	{
+		CResourceUtilisation ru;
+		unpackUtilisation(_nodes[node].utilisation, ru);
+		CFpgaItem* parent = node ? items[_nodes[node].parent] : NULL;
+		items[node] = _builder.createItem(getName(node), ru, parent);
+		items[node]->setColour(_nodes[node].colour);
+	}
+
+	_rootItem = items[0];
+	_builder.setItems(_rootItem);
+	_builder.finish();
+	return _rootItem;
+}
+
+uint32_t CSnapshot::getParent(uint32_t node) const
+{
+	return _nodes[node].parent;
+}
+
+uint32_t CSnapshot::getFirstChild(uint32_t node) const
+{
+	return getNumVisibleChildren(node, _UtilisationMetric) ? getChild(node, 0, _UtilisationMetric) : NO_NODE;
+}
+
+uint32_t CSnapshot::getPreviousSibling(uint32_t node) const
+{
+	const uint32_t parent = getParent(node);
+	const uint32_t index = getSortedIndex(node);
+	if (parent == NO_NODE || index == NO_NODE)
+	{
+		return NO_NODE;
+	}
+	if (index == 0)
+	{
+		return parent;
+	}
+	return getChild(parent, index - 1, _UtilisationMetric);
+}
+
+uint32_t CSnapshot::getNextSibling(uint32_t node) const
+{
+	while (true)
+	{
+		const uint32_t parent = getParent(node);
+		const uint32_t index = getSortedIndex(node);
+		if (parent == NO_NODE || index == NO_NODE)
+		{
+			return NO_NODE;
+		}
+		if (index + 1 < getNumVisibleChildren(parent, _UtilisationMetric))
+		{
+			return getChild(parent, index + 1, _UtilisationMetric);
+		}
+		node = parent;
+	}
+}
+
+void CSnapshot::printHierarchy(uint32_t node) const
+{
+	puts("---------------------------------------------");
+	const CStringSpan name = getName(0);
+	printf("%c %6" PRIu64 " : %-40.*s\n", isAncestor(node, 0) ? '-' : '+', getRecursiveSize(0, _UtilisationMetric), (int) name.getLength(), name.getData());
+	printTreeTo(0, node);
+}
+
+const char* CSnapshot::getFilename() const
+{
+	return _filename.c_str();
+}
+
+void CSnapshot::SetUtilisationMetric(EUtilisationMetric metric)
+{
+	_UtilisationMetric = metric;
+}
+
+bool CSnapshot::readReportKey(SReportKey& key) const
+{
+	// Rewriting the report changes its ctime whatever happens to the
+	// mtime, so the contents needn't be read
+	memset(&key, 0, sizeof(key));
+	struct stat st;
+	if (stat(_mapReport, &st) != 0)
+	{
+		return false;
+	}
+
+	key.size = st.st_size;
+	key.device = st.st_dev;
+	key.inode = st.st_ino;
+	key.mtimeSeconds = st.st_mtim.tv_sec;
+	key.mtimeNanoseconds = st.st_mtim.tv_nsec;
+	key.ctimeSeconds = st.st_ctim.tv_sec;
+	key.ctimeNanoseconds = st.st_ctim.tv_nsec;
+	return true;
+}
+
+void CSnapshot::attach(const char* data)
+{
+	_header = reinterpret_cast<const SHeader*>(data);
+	_nodes = reinterpret_cast<const SNode*>(data + _header->nodesOffset);
+	_childLists = reinterpret_cast<const uint32_t*>(data + _header->childListsOffset);
+	_strings = data + _header->stringTableOffset;
+	unpackUtilisation(_header->used, _used);
+	unpackUtilisation(_header->total, _total);
+
+	_items.clear();
+	_items.reserve(_header->numNodes);
+	for (uint32_t node = 0; node < _header->numNodes; node++)
+	{
+		_items.push_back(Item(this, node));
+	}
+}
+
+uint32_t CSnapshot::getSortedIndex(uint32_t node) const
+{
+	// a scan of the parent's order, only the navigation needs it
+	const uint32_t parent = getParent(node);
+	if (parent == NO_NODE)
+	{
+		return NO_NODE;
+	}
+	for (uint32_t c = 0; c < getNumVisibleChildren(parent, _UtilisationMetric); c++)
+	{
+		if (getChild(parent, c, _UtilisationMetric) == node)
+		{
+			return c;
+		}
+	}
+	return NO_NODE;
+}
+
+bool CSnapshot::isAncestor(uint32_t ancestor, uint32_t node) const
+{
+	for (uint32_t parent = getParent(node); parent != NO_NODE; parent = getParent(parent))
+	{
+		if (parent == ancestor)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t CSnapshot::getDepth(uint32_t node) const
+{
+	uint32_t depth = 0;
+	for (uint32_t parent = getParent(node); parent != NO_NODE; parent = getParent(parent))
+	{
+		depth++;
+	}
+	return depth;
+}
+
+void CSnapshot::printTreeTo(uint32_t node, uint32_t descendant) const
+{
+	if (node == descendant)
+	{
+		return;
+	}
+	const uint32_t depth = getDepth(node);
+	const uint32_t numChildren = getNumVisibleChildren(node, _UtilisationMetric);
+	for (uint32_t c = 0; c < numChildren; c++)
+	{
+		const uint32_t child = getChild(node, c, _UtilisationMetric);
+		for (uint32_t d = 0; d < depth + 1; d++)
+		{
+			fputs(child == descendant ? "**" : "  ", stdout);
+		}
+		const bool isDescendant = isAncestor(child, descendant);
+		const CStringSpan name = getName(child);
+		printf("%c %6" PRIu64 " : %-40.*s\n", getNumVisibleChildren(child, _UtilisationMetric) == 0 ? ' ' : isDescendant ? '-' : '+',
+				getRecursiveSize(child, _UtilisationMetric), (int) name.getLength(), name.getData());
+		if (isDescendant)
+		{
+			printTreeTo(child, descendant);
+		}
+	}
+}
+
+void CSnapshot::packUtilisation(const CResourceUtilisation& ru, uint32_t* values)
+{
+	for (uint32_t m = 0; m < NUM_UTILISATION_METRICS; m++)
+	{
+		values[m] = ru.get(static_cast<EUtilisationMetric>(m));
+	}
+}
+
+void CSnapshot::unpackUtilisation(const uint32_t* values, CResourceUtilisation& ru)
+{
+	ru.getSlices() = values[static_cast<uint32_t>(EUtilisationMetric::SLICE)];
+	ru.getRegisters() = values[static_cast<uint32_t>(EUtilisationMetric::REG)];
+	ru.getLuts() = values[static_cast<uint32_t>(EUtilisationMetric::LUT)];
+	ru.getDsps() = values[static_cast<uint32_t>(EUtilisationMetric::DSP)];
+	ru.getRams() = values[static_cast<uint32_t>(EUtilisationMetric::RAM)];
+}
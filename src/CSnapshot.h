@@ -0,0 +1,273 @@
+#ifndef SRC_CSNAPSHOT_H_
+#define SRC_CSNAPSHOT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CMappedFile.h"
+#include "CResourceUtilisation.h"
+#include "CStringSpan.h"
+#include "CTreeMapBuilder.h"
+#include "EUtilisationMetric.h"
+#include "windirstat/CTreeMap.h"
+
+class CFpgaItem;
+
+// Binary cache of a parsed map report, stored next to the report. The file
+// is a header, the nodes in preorder, each metric's sorted child lists and a
+// string table. The nodes carry their recursive sizes, so the viewer lays
+// the mapping out through CSnapshot::View as it is, with no items built.
+// It is only accepted when the size, inode, mtime and ctime of the report
+// match the ones it was written from.
+class CSnapshot
+{
+public:
+	static const uint32_t NO_NODE = 0xffffffff;
+
+	// CTreeMap::Item stand in for a node, so the layout has something
+	// to hand back for hit testing
+	class Item : public CTreeMap::Item
+	{
+	public:
+		Item(const CSnapshot* snapshot, uint32_t node);
+
+		uint32_t        getNode            () const;
+
+		// of the calling thread's metric, see SetUtilisationMetric()
+		bool            TmiIsLeaf          () const;
+		uint32_t        TmiGetGraphColor   () const;
+		int             TmiGetChildrenCount() const;
+		CTreeMap::Item* TmiGetChild        (int c) const;
+		uint64_t        TmiGetLocalSize    () const;
+		uint64_t        TmiGetRecursiveSize() const;
+
+	private:
+		const CSnapshot* _snapshot;
+		uint32_t _node;
+	};
+
+	// How CTreeMap's layout sees the snapshot for one metric (see
+	// CTreeMap::ItemView), every query is a read of the mapped nodes
+	class View
+	{
+	public:
+		typedef uint32_t Node;
+
+		View(const CSnapshot* snapshot, EUtilisationMetric metric);
+
+		bool            IsLeaf            (Node node) const;
+		int             GetChildrenCount  (Node node) const;
+		Node            GetChild          (Node node, int c) const;
+		uint64_t        GetLocalSize      (Node node) const;
+		uint64_t        GetRecursiveSize  (Node node) const;
+		uint32_t        GetGraphColor     (Node node) const;
+		CTreeMap::Item* GetItem           (Node node) const;
+
+	private:
+		const CSnapshot* _snapshot;
+		uint32_t _metric;
+	};
+
+	CSnapshot(const char* mapReport);
+	~CSnapshot();
+
+	// maps the snapshot if it is current, only the header is checked
+	bool load();
+	// flattens a finished tree in memory, usable as if it had been loaded
+	void create(CFpgaItem* items, const CResourceUtilisation& used, const CResourceUtilisation& total);
+	// writes what create() made
+	bool save();
+
+	// The rest is valid after load() or create()
+	const CResourceUtilisation& getUsed() const;
+	const CResourceUtilisation& getTotal() const;
+	// Rebuilds the hierarchy as CFpgaItems for image export, finished and
+	// referencing the string table. The viewer has no need for it.
+	CFpgaItem* createItems();
+
+	uint32_t getNumNodes() const;
+	const Item* getItem(uint32_t node) const;
+	CStringSpan getName(uint32_t node) const;
+	uint32_t getColour(uint32_t node) const;
+	uint32_t getLocalSize(uint32_t node, EUtilisationMetric metric) const;
+	uint64_t getRecursiveSize(uint32_t node, EUtilisationMetric metric) const;
+	// children of non-zero size, sorted largest first
+	uint32_t getNumVisibleChildren(uint32_t node, EUtilisationMetric metric) const;
+	uint32_t getChild(uint32_t node, uint32_t c, EUtilisationMetric metric) const;
+
+	// Navigation through the visible children of the calling thread's
+	// metric, as CFpgaItem does it, NO_NODE where there is nothing
+	uint32_t getParent(uint32_t node) const;
+	uint32_t getFirstChild(uint32_t node) const;
+	// the parent for the first child
+	uint32_t getPreviousSibling(uint32_t node) const;
+	// carries on after the parent for the last child
+	uint32_t getNextSibling(uint32_t node) const;
+	void printHierarchy(uint32_t node) const;
+
+	const char* getFilename() const;
+
+	// what the Item proxies and the navigation use, for the calling
+	// thread only
+	static void SetUtilisationMetric(EUtilisationMetric metric);
+
+private:
+	static const uint32_t VERSION = 2;
+
+	struct SReportKey
+	{
+		uint64_t size;
+		uint64_t device;
+		uint64_t inode;
+		int64_t mtimeSeconds;
+		int64_t mtimeNanoseconds;
+		int64_t ctimeSeconds;
+		int64_t ctimeNanoseconds;
+	};
+
+	struct SHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t numNodes;
+		SReportKey report;
+		uint32_t used[NUM_UTILISATION_METRICS];
+		uint32_t total[NUM_UTILISATION_METRICS];
+		uint64_t nodesOffset;
+		// NUM_UTILISATION_METRICS lists of numNodes - 1 node ids each
+		uint64_t childListsOffset;
+		uint64_t stringTableOffset;
+		uint64_t stringTableSize;
+	};
+
+	struct SNode
+	{
+		uint64_t recursiveSizes[NUM_UTILISATION_METRICS];
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint32_t parent;
+		uint32_t colour;
+		// this node's range in each child list, the first
+		// numVisibleChildren[m] of it hold the children sorted for metric m
+		uint32_t firstChild;
+		uint32_t numChildren;
+		uint32_t utilisation[NUM_UTILISATION_METRICS];
+		uint32_t numVisibleChildren[NUM_UTILISATION_METRICS];
+	};
+
+	bool readReportKey(SReportKey& key) const;
+	// points the section pointers into data and makes the proxies
+	void attach(const char* data);
+	uint32_t getSortedIndex(uint32_t node) const;
+	bool isAncestor(uint32_t ancestor, uint32_t node) const;
+	uint32_t getDepth(uint32_t node) const;
+	void printTreeTo(uint32_t node, uint32_t descendant) const;
+
+	static void packUtilisation(const CResourceUtilisation& ru, uint32_t* values);
+	static void unpackUtilisation(const uint32_t* values, CResourceUtilisation& ru);
+
+	const char* _mapReport;
+	std::string _filename;
+	// one of these holds the snapshot
+	CMappedFile _snapshot;
+	std::vector<char> _image;
+
+	const SHeader* _header;
+	const SNode* _nodes;
+	const uint32_t* _childLists;
+	const char* _strings;
+	std::vector<Item> _items;
+
+	CTreeMapBuilder _builder;
+	CFpgaItem* _rootItem;
+	CResourceUtilisation _used;
+	CResourceUtilisation _total;
+
+	static thread_local EUtilisationMetric _UtilisationMetric;
+};
+
+inline uint32_t CSnapshot::getNumNodes() const
+{
+	return _header->numNodes;
+}
+
+inline const CSnapshot::Item* CSnapshot::getItem(uint32_t node) const
+{
+	return &_items[node];
+}
+
+inline CStringSpan CSnapshot::getName(uint32_t node) const
+{
+	return CStringSpan(_strings + _nodes[node].nameOffset, _nodes[node].nameLength);
+}
+
+inline uint32_t CSnapshot::getColour(uint32_t node) const
+{
+	return _nodes[node].colour;
+}
+
+inline uint32_t CSnapshot::getLocalSize(uint32_t node, EUtilisationMetric metric) const
+{
+	return _nodes[node].utilisation[static_cast<uint32_t>(metric)];
+}
+
+inline uint64_t CSnapshot::getRecursiveSize(uint32_t node, EUtilisationMetric metric) const
+{
+	return _nodes[node].recursiveSizes[static_cast<uint32_t>(metric)];
+}
+
+inline uint32_t CSnapshot::getNumVisibleChildren(uint32_t node, EUtilisationMetric metric) const
+{
+	return _nodes[node].numVisibleChildren[static_cast<uint32_t>(metric)];
+}
+
+inline uint32_t CSnapshot::getChild(uint32_t node, uint32_t c, EUtilisationMetric metric) const
+{
+	return _childLists[static_cast<uint32_t>(metric) * (_header->numNodes - 1) + _nodes[node].firstChild + c];
+}
+
+inline CSnapshot::View::View(const CSnapshot* snapshot, EUtilisationMetric metric) :
+		_snapshot(snapshot),
+		_metric(static_cast<uint32_t>(metric))
+{
+
+}
+
+inline bool CSnapshot::View::IsLeaf(Node node) const
+{
+	return _snapshot->_nodes[node].numVisibleChildren[_metric] == 0;
+}
+
+inline int CSnapshot::View::GetChildrenCount(Node node) const
+{
+	return _snapshot->_nodes[node].numVisibleChildren[_metric];
+}
+
+inline CSnapshot::View::Node CSnapshot::View::GetChild(Node node, int c) const
+{
+	return _snapshot->_childLists[_metric * (_snapshot->_header->numNodes - 1) + _snapshot->_nodes[node].firstChild + c];
+}
+
+inline uint64_t CSnapshot::View::GetLocalSize(Node node) const
+{
+	return _snapshot->_nodes[node].utilisation[_metric];
+}
+
+inline uint64_t CSnapshot::View::GetRecursiveSize(Node node) const
+{
+	return _snapshot->_nodes[node].recursiveSizes[_metric];
+}
+
+inline uint32_t CSnapshot::View::GetGraphColor(Node node) const
+{
+	return _snapshot->_nodes[node].colour;
+}
+
+inline CTreeMap::Item* CSnapshot::View::GetItem(Node node) const
+{
+	// only an identity for the layout, it never calls the proxies
+	return const_cast<Item*>(_snapshot->getItem(node));
+}
+
+#endif /* SRC_CSNAPSHOT_H_ */
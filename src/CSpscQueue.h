@@ -0,0 +1,65 @@
+#ifndef SRC_CSPSCQUEUE_H_
+#define SRC_CSPSCQUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free ring buffer for one producer thread and one consumer thread.
+// Holds up to CAPACITY - 1 elements, CAPACITY must be a power of two.
+template <typename T, uint32_t CAPACITY>
+class CSpscQueue
+{
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+	CSpscQueue() :
+			_head(0),
+			_tail(0)
+	{
+
+	}
+
+	// Producer only, false if full
+	bool push(const T& element)
+	{
+		const uint32_t tail = _tail.load(std::memory_order_relaxed);
+		const uint32_t next = (tail + 1) & (CAPACITY - 1);
+		if (next == _head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		_elements[tail] = element;
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only, false if empty
+	bool pop(T& element)
+	{
+		const uint32_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		element = _elements[head];
+		_head.store((head + 1) & (CAPACITY - 1), std::memory_order_release);
+		return true;
+	}
+
+	// Either side, may be out of date by the time it returns
+	bool empty() const
+	{
+		return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+	}
+
+private:
+	CSpscQueue(const CSpscQueue&) = delete;
+	CSpscQueue& operator=(const CSpscQueue&) = delete;
+
+	T _elements[CAPACITY];
+	// on separate cache lines, each is written by one side only
+	alignas(64) std::atomic<uint32_t> _head;
+	alignas(64) std::atomic<uint32_t> _tail;
+};
+
+#endif /* SRC_CSPSCQUEUE_H_ */
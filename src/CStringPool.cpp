@@ -0,0 +1,91 @@
+#include "CStringPool.h"
+
+#include <cstring>
+
+CStringPool::CStringPool() :
+		_tableMask(0),
+		_numStrings(0)
+{
+	resize(1024);
+}
+
+CStringPool::~CStringPool()
+{
+
+}
+
+void CStringPool::reserve(uint32_t numStrings)
+{
+	// keep the load factor at or below a half
+	uint32_t tableSize = _table.size();
+	while (tableSize < 2 * numStrings)
+	{
+		tableSize *= 2;
+	}
+	if (tableSize != _table.size())
+	{
+		resize(tableSize);
+	}
+}
+
+void CStringPool::clear()
+{
+	SEntry empty = { NULL, 0, 0 };
+	_table.assign(_table.size(), empty);
+	_numStrings = 0;
+}
+
+CStringSpan CStringPool::intern(const CStringSpan& str)
+{
+	if (2 * (_numStrings + 1) > _table.size())
+	{
+		resize(2 * _table.size());
+	}
+
+	const uint32_t hash = str.hash();
+	uint32_t slot = hash & _tableMask;
+	while (_table[slot].data)
+	{
+		const SEntry& entry = _table[slot];
+		if (entry.hash == hash && entry.length == str.getLength() && memcmp(entry.data, str.getData(), str.getLength()) == 0)
+		{
+			return CStringSpan(entry.data, entry.length);
+		}
+		slot = (slot + 1) & _tableMask;
+	}
+
+	SEntry& entry = _table[slot];
+	entry.data = str.getData();
+	entry.length = str.getLength();
+	entry.hash = hash;
+	_numStrings++;
+	return str;
+}
+
+uint32_t CStringPool::getNumStrings() const
+{
+	return _numStrings;
+}
+
+void CStringPool::resize(uint32_t tableSize)
+{
+	std::vector<SEntry> oldTable;
+	oldTable.swap(_table);
+
+	SEntry empty = { NULL, 0, 0 };
+	_table.assign(tableSize, empty);
+	_tableMask = tableSize - 1;
+
+	for (const auto& entry : oldTable)
+	{
+		if (entry.data)
+		{
+			uint32_t slot = entry.hash & _tableMask;
+			while (_table[slot].data)
+			{
+				slot = (slot + 1) & _tableMask;
+			}
+			_table[slot] = entry;
+		}
+	}
+}
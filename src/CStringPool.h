@@ -0,0 +1,40 @@
+#ifndef SRC_CSTRINGPOOL_H_
+#define SRC_CSTRINGPOOL_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "CStringSpan.h"
+
+// Interns names so equal names share one span. Strings are not copied, the
+// first occurrence of each name (usually inside the mapped report) becomes
+// the canonical one, so it has to outlive the pool's users.
+class CStringPool
+{
+public:
+	CStringPool();
+	~CStringPool();
+
+	void reserve(uint32_t numStrings);
+	void clear();
+
+	CStringSpan intern(const CStringSpan& str);
+
+	uint32_t getNumStrings() const;
+
+private:
+	struct SEntry
+	{
+		const char* data;
+		uint32_t length;
+		uint32_t hash;
+	};
+
+	void resize(uint32_t tableSize);
+
+	std::vector<SEntry> _table;
+	uint32_t _tableMask;
+	uint32_t _numStrings;
+};
+
+#endif /* SRC_CSTRINGPOOL_H_ */
@@ -0,0 +1,96 @@
+#include "CStringSpan.h"
+
+bool CStringSpan::equals(const char* str) const
+{
+	uint32_t length = strlen(str);
+	return length == _length && memcmp(_data, str, length) == 0;
+}
+
+bool CStringSpan::contains(const char* needle) const
+{
+	return find(needle) >= 0;
+}
+
+int64_t CStringSpan::find(const char* needle) const
+{
+	uint32_t needleLength = strlen(needle);
+	if (needleLength == 0)
+	{
+		return 0;
+	}
+	if (needleLength > _length)
+	{
+		return -1;
+	}
+
+	const char* end = _data + _length - needleLength + 1;
+	const char* pos = _data;
+	while (pos < end)
+	{
+		pos = static_cast<const char*>(memchr(pos, needle[0], end - pos));
+		if (pos == NULL)
+		{
+			return -1;
+		}
+		if (memcmp(pos, needle, needleLength) == 0)
+		{
+			return pos - _data;
+		}
+		pos++;
+	}
+	return -1;
+}
+
+bool CStringSpan::nextToken(char delimiter, CStringSpan& token)
+{
+	while (_length && *_data == delimiter)
+	{
+		_data++;
+		_length--;
+	}
+	if (_length == 0)
+	{
+		return false;
+	}
+
+	const char* end = static_cast<const char*>(memchr(_data, delimiter, _length));
+	uint32_t tokenLength = end ? end - _data : _length;
+	token = CStringSpan(_data, tokenLength);
+
+	// consume the delimiter too, as strtok() does
+	uint32_t consumed = end ? tokenLength + 1 : tokenLength;
+	_data += consumed;
+	_length -= consumed;
+	return true;
+}
+
+uint32_t CStringSpan::toUint32() const
+{
+	uint32_t i = 0;
+	while (i < _length && (_data[i] == ' ' || _data[i] == '\t'))
+	{
+		i++;
+	}
+	if (i < _length && _data[i] == '+')
+	{
+		i++;
+	}
+
+	uint32_t value = 0;
+	while (i < _length && _data[i] >= '0' && _data[i] <= '9')
+	{
+		value = value * 10 + (_data[i] - '0');
+		i++;
+	}
+	return value;
+}
+
+uint32_t CStringSpan::hash() const
+{
+	uint32_t h = 2166136261U;
+	for (uint32_t i = 0; i < _length; i++)
+	{
+		h = (h ^ static_cast<uint8_t>(_data[i])) * 16777619U;
+	}
+	return h;
+}
@@ -0,0 +1,104 @@
+#ifndef SRC_CSTRINGSPAN_H_
+#define SRC_CSTRINGSPAN_H_
+
+#include <cstdint>
+#include <cstring>
+
+// Non-owning view of a run of characters, typically pointing straight into a
+// memory mapped map report. The characters are not NUL terminated, so print
+// them with "%.*s" and getLength()/getData().
+class CStringSpan
+{
+public:
+	CStringSpan();
+	CStringSpan(const char* str);
+	CStringSpan(const char* data, uint32_t length);
+
+	const char* getData() const;
+	uint32_t    getLength() const;
+	bool        isEmpty() const;
+	char        operator[](uint32_t index) const;
+
+	bool        equals(const char* str) const;
+	bool        contains(const char* needle) const;
+	int64_t     find(const char* needle) const;
+
+	CStringSpan substr(uint32_t offset) const;
+	CStringSpan substr(uint32_t offset, uint32_t length) const;
+
+	// strtok() style tokeniser: skips leading delimiters, returns the next
+	// token and consumes it (and the delimiter after it) from this span.
+	bool        nextToken(char delimiter, CStringSpan& token);
+
+	// strtoul() style conversion: leading whitespace, then decimal digits.
+	uint32_t    toUint32() const;
+
+	// FNV-1a
+	uint32_t    hash() const;
+
+private:
+	const char* _data;
+	uint32_t _length;
+};
+
+inline CStringSpan::CStringSpan() :
+		_data(""),
+		_length(0)
+{
+
+}
+
+inline CStringSpan::CStringSpan(const char* str) :
+		_data(str),
+		_length(strlen(str))
+{
+
+}
+
+inline CStringSpan::CStringSpan(const char* data, uint32_t length) :
+		_data(data),
+		_length(length)
+{
+
+}
+
+inline const char* CStringSpan::getData() const
+{
+	return _data;
+}
+
+inline uint32_t CStringSpan::getLength() const
+{
+	return _length;
+}
+
+inline bool CStringSpan::isEmpty() const
+{
+	return _length == 0;
+}
+
+inline char CStringSpan::operator[](uint32_t index) const
+{
+	return _data[index];
+}
+
+inline CStringSpan CStringSpan::substr(uint32_t offset) const
+{
+	if (offset > _length)
+	{
+		offset = _length;
+	}
+	return CStringSpan(_data + offset, _length - offset);
+}
+
+inline CStringSpan CStringSpan::substr(uint32_t offset, uint32_t length) const
+{
+	CStringSpan tail = substr(offset);
+	if (length < tail._length)
+	{
+		tail._length = length;
+	}
+	return tail;
+}
+
+#endif /* SRC_CSTRINGSPAN_H_ */
@@ -0,0 +1,181 @@
+#include "CThreadPool.h"
+
+#include <algorithm>
+
+thread_local CThreadPool* CThreadPool::_CurrentPool = NULL;
+thread_local uint32_t CThreadPool::_CurrentQueue = 0;
+
+CThreadPool::CTaskGroup::CTaskGroup() :
+		_tasksOutstanding(0)
+{
+
+}
+
+CThreadPool::CThreadPool(uint32_t numThreads) :
+		_tasksQueued(0),
+		_tasksOutstanding(0),
+		_stopping(false)
+{
+	if (numThreads == 0)
+	{
+		numThreads = std::max(1U, std::thread::hardware_concurrency());
+	}
+	for (uint32_t i = 0; i < numThreads + 1; i++)
+	{
+		_queues.push_back(std::unique_ptr<SQueue>(new SQueue()));
+	}
+	for (uint32_t i = 0; i < numThreads; i++)
+	{
+		_threads.push_back(std::thread(&CThreadPool::workerLoop, this, i));
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_taskAvailable.notify_all();
+	for (auto& thread : _threads)
+	{
+		thread.join();
+	}
+}
+
+uint32_t CThreadPool::getNumThreads() const
+{
+	return _threads.size();
+}
+
+void CThreadPool::submit(const std::function<void()>& task)
+{
+	push(task, NULL);
+}
+
+void CThreadPool::submit(CTaskGroup& group, const std::function<void()>& task)
+{
+	push(task, &group);
+}
+
+void CThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_allDone.wait(lock, [this]{ return _tasksOutstanding == 0; });
+}
+
+void CThreadPool::wait(CTaskGroup& group)
+{
+	STask task;
+	while (group._tasksOutstanding > 0)
+	{
+		if (tryPop(task))
+		{
+			execute(task);
+		}
+		else
+		{
+			// the rest of the group is running on other threads
+			std::this_thread::yield();
+		}
+	}
+}
+
+void CThreadPool::push(const std::function<void()>& function, CTaskGroup* group)
+{
+	// counted before the task can be seen, so it can't finish first
+	_tasksOutstanding++;
+	if (group)
+	{
+		group->_tasksOutstanding++;
+	}
+
+	SQueue& queue = *_queues[getOwnQueue()];
+	{
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(STask{function, group});
+	}
+	_tasksQueued++;
+
+	{
+		// a worker checks _tasksQueued under _mutex before sleeping, taking
+		// it here means the notification can't slip in between
+		std::unique_lock<std::mutex> lock(_mutex);
+	}
+	_taskAvailable.notify_one();
+}
+
+bool CThreadPool::tryPop(STask& task)
+{
+	const uint32_t numQueues = _queues.size();
+	const uint32_t ownQueue = getOwnQueue();
+	for (uint32_t i = 0; i < numQueues; i++)
+	{
+		SQueue& queue = *_queues[(ownQueue + i) % numQueues];
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+		{
+			continue;
+		}
+		if (i == 0)
+		{
+			// newest first, its data is most likely still in cache
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			// oldest first, usually the biggest piece of work left
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		_tasksQueued--;
+		return true;
+	}
+	return false;
+}
+
+void CThreadPool::execute(STask& task)
+{
+	task.function();
+	task.function = nullptr;
+
+	// the group may be gone as soon as its count drops to zero
+	if (task.group)
+	{
+		task.group->_tasksOutstanding--;
+	}
+	if (--_tasksOutstanding == 0)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_allDone.notify_all();
+	}
+}
+
+uint32_t CThreadPool::getOwnQueue() const
+{
+	return _CurrentPool == this ? _CurrentQueue : _queues.size() - 1;
+}
+
+void CThreadPool::workerLoop(uint32_t queue)
+{
+	_CurrentPool = this;
+	_CurrentQueue = queue;
+
+	STask task;
+	while (1)
+	{
+		if (tryPop(task))
+		{
+			execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_taskAvailable.wait(lock, [this]{ return _stopping || _tasksQueued > 0; });
+		if (_stopping && _tasksQueued <= 0)
+		{
+			return;
+		}
+	}
+}
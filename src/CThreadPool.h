@@ -0,0 +1,89 @@
+#ifndef SRC_CTHREADPOOL_H_
+#define SRC_CTHREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads. Each worker has its own task queue which
+// it works through newest first, and steals the oldest task of another queue
+// when its own runs dry. Tasks submitted from outside the pool go to a shared
+// queue that every worker steals from.
+class CThreadPool
+{
+public:
+	// Tasks submitted to a group can be waited for on their own. The waiting
+	// thread runs queued tasks meanwhile, so a task may fork into the group
+	// and wait for it without tying up a worker (see CFpgaItem).
+	class CTaskGroup
+	{
+	public:
+		CTaskGroup();
+
+	private:
+		friend class CThreadPool;
+
+		CTaskGroup(const CTaskGroup&) = delete;
+		CTaskGroup& operator=(const CTaskGroup&) = delete;
+
+		std::atomic<uint32_t> _tasksOutstanding;
+	};
+
+	// numThreads == 0 uses one thread per hardware thread
+	CThreadPool(uint32_t numThreads = 0);
+	~CThreadPool();
+
+	uint32_t getNumThreads() const;
+
+	void submit(const std::function<void()>& task);
+	void submit(CTaskGroup& group, const std::function<void()>& task);
+
+	// blocks until every task submitted so far has finished
+	void wait();
+	// runs tasks until every task of the group has finished
+	void wait(CTaskGroup& group);
+
+private:
+	struct STask
+	{
+		std::function<void()> function;
+		CTaskGroup* group;
+	};
+
+	struct SQueue
+	{
+		std::mutex mutex;
+		std::deque<STask> tasks;
+	};
+
+	CThreadPool(const CThreadPool&) = delete;
+	CThreadPool& operator=(const CThreadPool&) = delete;
+
+	void push(const std::function<void()>& function, CTaskGroup* group);
+	bool tryPop(STask& task);
+	void execute(STask& task);
+	uint32_t getOwnQueue() const;
+	void workerLoop(uint32_t queue);
+
+	std::vector<std::thread> _threads;
+	// one per worker, the last one takes submissions from other threads
+	std::vector<std::unique_ptr<SQueue>> _queues;
+	std::mutex _mutex;
+	std::condition_variable _taskAvailable;
+	std::condition_variable _allDone;
+	// may dip below zero while a task is popped before its push is counted
+	std::atomic<int32_t> _tasksQueued;
+	std::atomic<uint32_t> _tasksOutstanding;
+	bool _stopping;
+
+	static thread_local CThreadPool* _CurrentPool;
+	static thread_local uint32_t _CurrentQueue;
+};
+
+#endif /* SRC_CTHREADPOOL_H_ */
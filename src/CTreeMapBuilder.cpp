@@ -1,10 +1,10 @@
 #include "CTreeMapBuilder.h"
 
 #include "CFpgaItem.h"
+#include "CThreadPool.h"
 
-CTreeMapBuilder::CTreeMapBuilder(CFpgaItem* items) :
-		_items(items),
-		_lastItem(NULL)
+CTreeMapBuilder::CTreeMapBuilder() :
+		_items(NULL)
 {
 
 }
@@ -14,67 +14,98 @@ CTreeMapBuilder::~CTreeMapBuilder()
 
 }
 
+void CTreeMapBuilder::reserve(uint32_t numItems)
+{
+	// room for the items plus their child arrays, which average less than
+	// two pointers per item including the slack from doubling, and one
+	// sorted order per metric
+	_arena.reserve(numItems * (sizeof(CFpgaItem) + (2 + NUM_UTILISATION_METRICS) * sizeof(CFpgaItem*)));
+	_names.reserve(numItems);
+}
+
+CFpgaItem* CTreeMapBuilder::createItem(const CStringSpan& name, const CResourceUtilisation& ru, CFpgaItem* parent)
+{
+	CFpgaItem* item = _arena.create<CFpgaItem>(_names.intern(name), ru, parent);
+	if (parent)
+	{
+		parent->addChild(item, _arena);
+	}
+	return item;
+}
+
+CFpgaItem* CTreeMapBuilder::getItems() const
+{
+	return _items;
+}
+
+void CTreeMapBuilder::setItems(CFpgaItem* items)
+{
+	_items = items;
+	_ancestors.clear();
+}
+
 void CTreeMapBuilder::reset()
 {
 	_items->clear();
-	_lastItem = NULL;
+	_ancestors.clear();
+}
+
+void CTreeMapBuilder::finish()
+{
+	uint32_t numItems = _items->prepare(_arena);
+	if (numItems >= 2 * CFpgaItem::PARALLEL_SUBTREE_SIZE && std::thread::hardware_concurrency() > 1)
+	{
+		CThreadPool pool;
+		_items->recursivelyCalculateSize(pool);
+		_items->sort(pool);
+	}
+	else
+	{
+		_items->recursivelyCalculateSize();
+		_items->sort();
+	}
 }
 
-void CTreeMapBuilder::addElement(const char* elementId, const CResourceUtilisation& ru)
+void CTreeMapBuilder::addElement(const CStringSpan& elementId, const CResourceUtilisation& ru)
 {
 	uint32_t thisElementDepth = getHeirachyDepth(elementId);
-	if(_lastItem == NULL)
+	if(_ancestors.empty())
 	{
 		if(thisElementDepth != 0)
 		{
-			fprintf(stderr, "Expected root element but got %s (depth = %u)\n", elementId, thisElementDepth);
+			fprintf(stderr, "Expected root element but got %.*s (depth = %u)\n", (int) elementId.getLength(), elementId.getData(), thisElementDepth);
 			exit(1);
 		}
 		_items->clear();
-		CFpgaItem* item = new CFpgaItem(elementId + thisElementDepth, ru, _items);
-		_items->addChild(item);
-		_lastItem = item;
+		_ancestors.push_back(_items);
 	}
 	else
 	{
-		uint32_t lastHeirachyDepth = _lastItem->getDepth();
-		CFpgaItem* parent = NULL;
+		// the root element hangs off _items just like the depth 1 rows, so
+		// the last item is always at depth _ancestors.size() - 1
+		uint32_t lastHeirachyDepth = _ancestors.size() - 1;
 
-		if(thisElementDepth > lastHeirachyDepth)
+		if(thisElementDepth > lastHeirachyDepth + 1)
 		{
-			if(thisElementDepth - lastHeirachyDepth == 1)
-			{
-				parent = _lastItem;
-			}
-			else
-			{
-				fprintf(stderr, "We appear to have descended two levels of heirachy (%u -> %u), exiting\n", thisElementDepth, lastHeirachyDepth);
-				exit(1);
-			}
+			fprintf(stderr, "We appear to have descended two levels of heirachy (%u -> %u), exiting\n", thisElementDepth, lastHeirachyDepth);
+			exit(1);
 		}
-		else
+		if(thisElementDepth == 0)
 		{
-			parent = _lastItem;
-			uint32_t parentDepth = lastHeirachyDepth;
-			while(parentDepth >= thisElementDepth)
-			{
-				parent = parent->getParent();
-				parentDepth--;
-			}
+			fprintf(stderr, "Expected a single root element but got %.*s as well, exiting\n", (int) elementId.getLength(), elementId.getData());
+			exit(1);
 		}
-		CFpgaItem* item = new CFpgaItem(elementId + thisElementDepth, ru, parent);
-		parent->addChild(item);
-		_lastItem = item;
+		_ancestors.resize(thisElementDepth);
 	}
+	_ancestors.push_back(createItem(elementId.substr(thisElementDepth), ru, _ancestors.back()));
 }
 
-uint32_t CTreeMapBuilder::getHeirachyDepth(const char* elementId)
+uint32_t CTreeMapBuilder::getHeirachyDepth(const CStringSpan& elementId)
 {
 	uint32_t depth = 0;
-	while(*elementId == '+')
+	while(depth < elementId.getLength() && elementId[depth] == '+')
 	{
 		depth++;
-		elementId++;
 	}
 	return depth;
 }
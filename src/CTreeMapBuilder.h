@@ -1,26 +1,50 @@
 #ifndef SRC_CTREEMAPBUILDER_H_
 #define SRC_CTREEMAPBUILDER_H_
 
+#include <vector>
+
+#include "CArena.h"
 #include "CResourceUtilisation.h"
+#include "CStringPool.h"
+#include "CStringSpan.h"
 
 class CFpgaItem;
 
+// Builds CFpgaItem trees. Every item, child array and the name pool belong to
+// the builder and are freed in one go when it is destroyed.
 class CTreeMapBuilder
 {
 public:
-	CTreeMapBuilder(CFpgaItem* items);
+	CTreeMapBuilder();
 	~CTreeMapBuilder();
 
+	// size the arena and name pool up front for numItems items
+	void reserve(uint32_t numItems);
+
+	CFpgaItem* createItem(const CStringSpan& name, const CResourceUtilisation& ru, CFpgaItem* parent);
+
+	CFpgaItem* getItems() const;
+	void setItems(CFpgaItem* items);
+
 	void reset();
 
-	void addElement(const char* elementId, const CResourceUtilisation& ru);
+	// sums every metric and sorts the children, once the tree is complete
+	void finish();
+
+	void addElement(const CStringSpan& elementId, const CResourceUtilisation& ru);
 
 private:
 
+	CArena _arena;
+	CStringPool _names;
 	CFpgaItem* _items;
-	CFpgaItem* _lastItem;
+	// _ancestors[d] is the last item added at depth d, so each row finds its
+	// parent without walking up the tree. "-p 1000000" shows it level with the
+	// walk at 30 levels, where creating the items takes the time, and about
+	// 3x faster at 300, see CParseBenchmark.
+	std::vector<CFpgaItem*> _ancestors;
 
-	uint32_t getHeirachyDepth(const char* elementId);
+	uint32_t getHeirachyDepth(const CStringSpan& elementId);
 
 };
 
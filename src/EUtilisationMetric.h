@@ -1,6 +1,8 @@
 #ifndef SRC_EUTILISATIONMETRIC_H_
 #define SRC_EUTILISATIONMETRIC_H_
 
+#include <cstdint>
+
 enum class EUtilisationMetric
 {
 	SLICE,
@@ -10,4 +12,6 @@ enum class EUtilisationMetric
 	RAM
 };
 
+static const uint32_t NUM_UTILISATION_METRICS = 5;
+
 #endif /* SRC_EUTILISATIONMETRIC_H_ */
@@ -1,37 +1,286 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string>
+#include <vector>
 
+#include "CBatchRenderer.h"
 #include "CFpgaItem.h"
+#include "CLayoutBenchmark.h"
 #include "CMrpParser.h"
+#include "CParseBenchmark.h"
+#include "CParserCheck.h"
+#include "CRenderThread.h"
+#include "CShaderBenchmark.h"
+#include "CSnapshot.h"
 #include "CSdlDisplay.h"
-#include "windirstat/CRect.h"
-#include "windirstat/CTreeMap.h"
+#include "CThreadPool.h"
+
+// Same size as the window
+static const uint32_t IMAGE_SIZE = 900;
+static const uint32_t BENCHMARK_REPETITIONS = 10;
+static const uint32_t SHADER_CHECK_CUSHIONS = 2000;
+// as deep as real designs go, then deep enough for walking the parents to show
+static const uint32_t PARSE_BENCHMARK_DEPTHS[] = { 30, 300 };
+
+static void usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s [-o image.png|image.ppm [-a pixels] [-f] [-g | [-m metric]... [-s item]...]] map_report_file\n", program);
+	fprintf(stderr, "       %s -b num_items\n", program);
+	fprintf(stderr, "       %s -p num_rows\n", program);
+	fprintf(stderr, "       %s -c\n", program);
+	fprintf(stderr, "       %s -t map_report_file\n", program);
+	fprintf(stderr, "  -o  render to an image instead of opening a window\n");
+	fprintf(stderr, "  -a  draw subtrees smaller than this many pixels as one block\n");
+	fprintf(stderr, "  -f  experimental: lay out a structure-of-arrays copy of the tree (CFlatTree)\n");
+	fprintf(stderr, "      instead, one copy per metric, slower unless there are many images\n");
+	fprintf(stderr, "  -g  every metric of the design and of each top level item, in parallel\n");
+	fprintf(stderr, "  -m  slice, reg, lut, dsp or ram, default reg\n");
+	fprintf(stderr, "  -s  the first item with this name, default the whole design\n");
+	fprintf(stderr, "  -b  time the treemap layout on a random tree of that many items\n");
+	fprintf(stderr, "  -p  time parsing synthetic reports of that many rows, 30 and 300 levels deep\n");
+	fprintf(stderr, "  -c  check the cushion shaders against the scalar one, then time them\n");
+	fprintf(stderr, "  -t  check the SIMD row tokenisers build the same tree as the scalar one\n");
+	fprintf(stderr, "With several metrics or items each image gets _<item>_<metric> added to its name.\n");
+	exit(1);
+}
 
 int main(int argc, char** argv)
 {
-	if(argc != 2)
+	const char* imageFile = NULL;
+	bool gallery = false;
+	bool flatTree = false;
+	std::vector<EUtilisationMetric> metrics;
+	std::vector<const char*> itemNames;
+	uint32_t benchmarkItems = 0;
+	uint32_t benchmarkRows = 0;
+	uint32_t lodArea = 0;
+	bool shaderBenchmark = false;
+	bool parserCheck = false;
+
+	int option;
+	while ((option = getopt(argc, argv, "o:a:fgm:s:b:p:ct")) != -1)
 	{
-		fprintf(stderr, "Usage: %s map_report_file\n", argv[0]);
-		exit(1);
+		switch (option)
+		{
+			case 'o':
+			{
+				imageFile = optarg;
+				break;
+			}
+			case 'a':
+			{
+				lodArea = strtoul(optarg, NULL, 10);
+				break;
+			}
+			case 'f':
+			{
+				flatTree = true;
+				break;
+			}
+			case 'g':
+			{
+				gallery = true;
+				break;
+			}
+			case 'm':
+			{
+				EUtilisationMetric metric;
+				if (!CBatchRenderer::parseMetric(optarg, metric))
+				{
+					fprintf(stderr, "Unknown metric: %s\n", optarg);
+					usage(argv[0]);
+				}
+				metrics.push_back(metric);
+				break;
+			}
+			case 's':
+			{
+				itemNames.push_back(optarg);
+				break;
+			}
+			case 'b':
+			{
+				benchmarkItems = strtoul(optarg, NULL, 10);
+				if (benchmarkItems == 0)
+				{
+					usage(argv[0]);
+				}
+				break;
+			}
+			case 'p':
+			{
+				benchmarkRows = strtoul(optarg, NULL, 10);
+				if (benchmarkRows == 0)
+				{
+					usage(argv[0]);
+				}
+				break;
+			}
+			case 'c':
+			{
+				shaderBenchmark = true;
+				break;
+			}
+			case 't':
+			{
+				parserCheck = true;
+				break;
+			}
+			default:
+			{
+				usage(argv[0]);
+			}
+		}
+	}
+
+	if (parserCheck)
+	{
+		if (optind != argc - 1 || shaderBenchmark || benchmarkItems || benchmarkRows || imageFile || lodArea || flatTree || gallery || !metrics.empty() || !itemNames.empty())
+		{
+			usage(argv[0]);
+		}
+		CParserCheck check(argv[optind]);
+		return check.check() ? 0 : 1;
+	}
+
+	if (shaderBenchmark)
+	{
+		if (optind != argc || benchmarkItems || benchmarkRows || imageFile || lodArea || flatTree || gallery || !metrics.empty() || !itemNames.empty())
+		{
+			usage(argv[0]);
+		}
+		CShaderBenchmark benchmark;
+		if (!benchmark.check(SHADER_CHECK_CUSHIONS))
+		{
+			return 1;
+		}
+		benchmark.run();
+		return 0;
+	}
+
+	if (benchmarkRows)
+	{
+		if (optind != argc || benchmarkItems || imageFile || lodArea || flatTree || gallery || !metrics.empty() || !itemNames.empty())
+		{
+			usage(argv[0]);
+		}
+		for (uint32_t maxDepth : PARSE_BENCHMARK_DEPTHS)
+		{
+			CParseBenchmark benchmark(benchmarkRows, maxDepth);
+			if (!benchmark.run(BENCHMARK_REPETITIONS))
+			{
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	if (benchmarkItems)
+	{
+		if (optind != argc || imageFile || lodArea || flatTree || gallery || !metrics.empty() || !itemNames.empty())
+		{
+			usage(argv[0]);
+		}
+		CLayoutBenchmark benchmark(benchmarkItems, IMAGE_SIZE, IMAGE_SIZE);
+		benchmark.run(BENCHMARK_REPETITIONS);
+		return 0;
+	}
+
+	if (optind != argc - 1 || (!imageFile && (gallery || lodArea || flatTree || !metrics.empty() || !itemNames.empty())) || (gallery && (!metrics.empty() || !itemNames.empty())))
+	{
+		usage(argv[0]);
 	}
 
-	const char* mapReport = argv[1];
+	const char* mapReport = argv[optind];
 	if(access(mapReport, R_OK) != 0)
 	{
 		fprintf(stderr, "Unable to read file: %s\n", mapReport);
 		exit(1);
 	}
 
+	// Reuse the snapshot written by an earlier run if the report is unchanged,
+	// otherwise parse and write a new one. The viewer draws straight from the
+	// snapshot either way. Both hold the names the items point at so they
+	// live until we exit.
+	CSnapshot snapshot(mapReport);
 	CMrpParser mrpParser(mapReport);
-	mrpParser.parse();
+	CFpgaItem* root = NULL;
+
+	if(snapshot.load())
+	{
+		CMrpParser::printUtilisation(snapshot.getUsed(), snapshot.getTotal());
+	}
+	else
+	{
+		mrpParser.parse();
+		CMrpParser::printUtilisation(mrpParser.getUsed(), mrpParser.getTotal());
+		root = mrpParser.getItems();
+		snapshot.create(root, mrpParser.getUsed(), mrpParser.getTotal());
+		snapshot.save();
+	}
+
+	// shared by the renderer's tiles
+	CThreadPool threadPool;
+
+	if (imageFile)
+	{
+		// Headless, SDL is never initialised. Export draws CFpgaItems.
+		if (!root)
+		{
+			root = snapshot.createItems();
+		}
+		CBatchRenderer renderer(root, IMAGE_SIZE, IMAGE_SIZE);
+		renderer.setThreadPool(&threadPool);
+		renderer.setLodArea(lodArea);
+		renderer.setUseFlatTree(flatTree);
+
+		if (gallery)
+		{
+			return renderer.renderGallery(threadPool, imageFile) ? 0 : 1;
+		}
 
-	CFpgaItem* root = mrpParser.getItems();
+		std::vector<CFpgaItem*> items;
+		for (const char* name : itemNames)
+		{
+			CFpgaItem* item = renderer.findItem(name);
+			if (!item)
+			{
+				fprintf(stderr, "No item named %s\n", name);
+				exit(1);
+			}
+			items.push_back(item);
+		}
+		if (items.empty())
+		{
+			items.push_back(root);
+		}
+		if (metrics.empty())
+		{
+			metrics.push_back(EUtilisationMetric::REG);
+		}
 
-	CTreeMap* treemap = new CTreeMap(NULL);
+		const bool variants = items.size() > 1 || metrics.size() > 1;
+		for (CFpgaItem* item : items)
+		{
+			for (EUtilisationMetric metric : metrics)
+			{
+				const std::string filename = variants ? CBatchRenderer::getVariantFilename(imageFile, CBatchRenderer::getItemLabel(item), metric) : imageFile;
+				if (!renderer.render(item, metric, filename.c_str()))
+				{
+					exit(1);
+				}
+			}
+		}
+		return 0;
+	}
 
 	CSdlDisplay* display = new CSdlDisplay();
-	display->run(treemap, mrpParser.getItems());
+	CRenderThread renderThread(&threadPool, display->getWidth(), display->getHeight(), [display]
+	{
+		display->wake();
+	});
+	display->run(&renderThread, &snapshot);
 
 	return 0;
 }
@@ -22,6 +22,8 @@
 #include <assert.h>
 #include "CTreeMap.h"
 #include "CColorSpace.h"
+#include "../CCushionShader.h"
+#include "../CThreadPool.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -45,10 +47,12 @@ static const double PALETTE_BRIGHTNESS = 0.6;
 /////////////////////////////////////////////////////////////////////////////
 
 const CTreeMap::Options CTreeMap::_defaultOptions =
-{ SequoiaViewStyle, false, RGB(0, 0, 0), 0.88, 0.38, 0.91, 0.13, -1.0, -1.0 };
+{ SequoiaViewStyle, false, RGB(0, 0, 0), 0.88, 0.38, 0.91, 0.13, -1.0, -1.0, 0 };
 
 const CTreeMap::Options CTreeMap::_defaultOptionsOld =
-{ KDirStatStyle, false, RGB(0, 0, 0), 0.85, 0.4, 0.9, 0.15, -1.0, -1.0 };
+{ KDirStatStyle, false, RGB(0, 0, 0), 0.85, 0.4, 0.9, 0.15, -1.0, -1.0, 0 };
+
+const uint32_t CTreeMap::TILE_SIZE;
 
 const uint32_t CTreeMap::_defaultCushionColors[] =
 { RGB(0, 0, 255), RGB(255, 0, 0), RGB(0, 255, 0), RGB(0, 255, 255), RGB(255, 0, 255), RGB(255, 255, 0), RGB(150, 150, 255), RGB(255, 150, 150), RGB(150, 255, 150), RGB(150, 255, 255), RGB(255, 150, 255), RGB(255, 255, 150), RGB(255, 255, 255) };
@@ -99,6 +103,10 @@ CTreeMap::Options CTreeMap::GetOldDefaultOptions()
 CTreeMap::CTreeMap(Callback *callback)
 {
 	m_callback = callback;
+	m_threadPool = NULL;
+	m_layoutEmpty = true;
+	m_cancelled = false;
+	m_layoutIndexMask = 0;
 	SetOptions(&_defaultOptions);
 	SetBrightnessFor256();
 }
@@ -134,44 +142,37 @@ void CTreeMap::SetBrightnessFor256()
 	}
 }
 
-#ifdef _DEBUG
-void CTreeMap::RecurseCheckTree(Item *item)
+
+void CTreeMap::DrawTreemap(CFrameBuffer* display, CRect rc, Item *root, const Options *options)
 {
-	if(item->TmiIsLeaf())
-	{
-		ASSERT(item->TmiGetChildrenCount() == 0);
-	}
-	else
-	{
-// TODO: check that children are sorted by size.
-		uint64_t sum = 0;
-		for(int i = 0; i < item->TmiGetChildrenCount(); i++)
-		{
-			Item *child = item->TmiGetChild(i);
-			sum += child->TmiGetRecursiveSize();
-			RecurseCheckTree(child);
-		}
-		ASSERT(sum == item->TmiGetRecursiveSize());
-	}
+	DrawTreemap(display, rc, ItemView(), root, options);
 }
-#endif
 
-void CTreeMap::DrawTreemap(CSdlDisplay* display, CRect rc, Item *root, const Options *options)
+void CTreeMap::Layout(CRect rc, Item *root, const Options *options)
 {
-#ifdef _DEBUG
-	RecurseCheckTree(root);
-#endif // _DEBUG
+	Layout(rc, ItemView(), root, options);
+}
+
 
+void CTreeMap::Render(CFrameBuffer* display, const Options *options)
+{
 	if (options != NULL)
 	{
 		SetOptions(options);
 	}
 
+	m_cancelled = false;
+
+	CRect rc = m_layoutArea;
+
 	if (rc.getWidth() <= 0 || rc.getHeight() <= 0)
 	{
 		return;
 	}
 
+	// Nothing under the border lines or an empty root
+	m_pickBuffer.assign(rc.getWidth() * rc.getHeight(), 0);
+
 	if (m_options.grid)
 	{
 		display->fillSolidRect(rc, m_options.gridColor);
@@ -202,668 +203,294 @@ void CTreeMap::DrawTreemap(CSdlDisplay* display, CRect rc, Item *root, const Opt
 		return;
 	}
 
-	m_renderArea = rc;
-
-	if (root->TmiGetRecursiveSize() > 0)
+	if (m_layoutEmpty)
 	{
-		double surface[4];
-		for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
-		{
-			surface[i] = 0;
-		}
+		display->fillSolidRect(rc, RGB(33, 33, 33));
+		return;
+	}
 
-		// Recursively draw the tree graph
-		RecurseDrawGraph(display, root, rc, true, surface, m_options.height, 0);
+	int gridWidth = m_options.grid ? 1 : 0;
 
-#ifdef STRONGDEBUG  // slow, but finds bugs!
-#ifdef _DEBUG
-		for(int x = rc.getLeft(); x < rc.getRight() - m_options.grid; x++)
+	// Each tile gets the entries overlapping it, still in drawing
+	// order, so every pixel ends up with the same entry on top.
+	const bool tiled = m_threadPool != NULL && m_threadPool->getNumThreads() > 1;
+	const uint32_t tilesX = (rc.getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t tilesY = (rc.getHeight() + TILE_SIZE - 1) / TILE_SIZE;
+	std::vector<std::vector<uint32_t>> tiles(tiled ? tilesX * tilesY : 0);
+
+	for (uint32_t i = 0; i < m_layout.size();)
+	{
+		if (m_callback != NULL)
 		{
-			for(int y = rc.getTop(); y < rc.getBottom() - m_options.grid; y++)
+			m_callback->TreemapDrawingCallback();
+			if (m_cancelled)
 			{
-				ASSERT(FindItemByPoint(root, CPoint(x, y)) != NULL);
+				return;
 			}
 		}
-#endif
-#endif
-	}
-	else
-	{
-		display->fillSolidRect(rc, RGB(33, 33, 33));
-	}
-}
 
-CTreeMap::Item *CTreeMap::FindItemByPoint(Item *item, CPoint point)
-{
-	ASSERT(item != NULL);
-	const CRect& rc = item->TmiGetRectangle();
+		const LayoutRect& entry = m_layout[i];
 
-	if (!rc.ptInRect(point))
-	{
-		// The only case that this function returns NULL is that
-		// point is not inside the rectangle of item.
-		//
-		// Take notice of
-		// (a) the very right an bottom lines, which can be "grid" and
-		//     are not covered by the root rectangle,
-		// (b) the fact, that WM_MOUSEMOVEs can occur after WM_SIZE but
-		//     before WM_PAINT.
-		//
-		return NULL;
-	}
-
-	Item *ret = NULL;
+		// No room inside the grid lines, for the children neither.
+		// Only picked, the same as FindItemByPoint() does.
+		const bool thin = entry.rc.getWidth() <= gridWidth || entry.rc.getHeight() <= gridWidth;
 
-	int gridWidth = m_options.grid ? 1 : 0;
-
-	if (rc.getWidth() <= gridWidth || rc.getHeight() <= gridWidth)
-	{
-		ret = item;
-	}
-	else if (item->TmiIsLeaf())
-	{
-		ret = item;
-	}
-	else
-	{
-		ASSERT(item->TmiGetRecursiveSize() > 0);
-		ASSERT(item->TmiGetChildrenCount() > 0);
-
-		for (int i = 0; i < item->TmiGetChildrenCount(); i++)
+		// Anything else is covered by its children
+		if (entry.paint || thin)
 		{
-			Item *child = item->TmiGetChild(i);
-
-			ASSERT(child->TmiGetRecursiveSize() > 0);
-
-#ifdef _DEBUG
-			CRect rcChild(child->TmiGetRectangle());
-			ASSERT(rcChild.getRight() >= rcChild.getLeft());
-			ASSERT(rcChild.getBottom() >= rcChild.getTop());
-			ASSERT(rcChild.getLeft() >= rc.getLeft());
-			ASSERT(rcChild.getRight() <= rc.getRight());
-			ASSERT(rcChild.getTop() >= rc.getTop());
-			ASSERT(rcChild.getBottom() <= rc.getBottom());
-#endif
-			if (child->TmiGetRectangle().ptInRect(point))
+			if (tiled)
 			{
-				ret = FindItemByPoint(child, point);
-				ASSERT(ret != NULL);
-#ifdef STRONGDEBUG
-#ifdef _DEBUG
-				for(i++; i < item->TmiGetChildrenCount(); i++)
+				const uint32_t left = (entry.rc.getLeft() - rc.getLeft()) / TILE_SIZE;
+				const uint32_t right = (entry.rc.getRight() - 1 - rc.getLeft()) / TILE_SIZE;
+				const uint32_t top = (entry.rc.getTop() - rc.getTop()) / TILE_SIZE;
+				const uint32_t bottom = (entry.rc.getBottom() - 1 - rc.getTop()) / TILE_SIZE;
+				for (uint32_t ty = top; ty <= bottom; ty++)
 				{
-					child = item->TmiGetChild(i);
-
-					if(child->TmiGetRecursiveSize() == 0)
+					for (uint32_t tx = left; tx <= right; tx++)
 					{
-						break;
+						tiles[tx + ty * tilesX].push_back(i);
 					}
-
-					rcChild = child->TmiGetRectangle();
-					if(rcChild.getLeft() == -1)
-					{
-						ASSERT(rcChild.getTop() == -1);
-						ASSERT(rcChild.getRight() == -1);
-						ASSERT(rcChild.getBottom() == -1);
-						break;
-					}
-
-					ASSERT(rcChild.getRight() >= rcChild.getLeft());
-					ASSERT(rcChild.getBottom() >= rcChild.getTop());
-					ASSERT(rcChild.getLeft() >= rc.getLeft());
-					ASSERT(rcChild.getRight() <= rc.getRight());
-					ASSERT(rcChild.getTop() >= rc.getTop());
-					ASSERT(rcChild.getBottom() <= rc.getBottom());
 				}
-#endif
-#endif
-
-				break;
+			}
+			else
+			{
+				RenderEntry(display, i, thin, rc);
 			}
 		}
+		i = thin ? entry.end : i + 1;
 	}
-	if(ret == NULL && item->TmiGetLocalSize())
+
+	if (tiled)
 	{
-		return item;
+		CThreadPool::CTaskGroup group;
+		for (uint32_t t = 0; t < tiles.size(); t++)
+		{
+			if (tiles[t].empty())
+			{
+				continue;
+			}
+			const uint32_t left = rc.getLeft() + (t % tilesX) * TILE_SIZE;
+			const uint32_t top = rc.getTop() + (t / tilesX) * TILE_SIZE;
+			const CRect clip(left, top, std::min(TILE_SIZE, rc.getRight() - left), std::min(TILE_SIZE, rc.getBottom() - top));
+			const std::vector<uint32_t>& entries = tiles[t];
+			m_threadPool->submit(group, [this, display, clip, gridWidth, &entries]()
+			{
+				for (uint32_t i : entries)
+				{
+					const CRect& rc = m_layout[i].rc;
+					RenderEntry(display, i, rc.getWidth() <= gridWidth || rc.getHeight() <= gridWidth, clip);
+				}
+			});
+		}
+		m_threadPool->wait(group);
 	}
 
-	ASSERT(ret != NULL);
-
-	if (ret == NULL)
+#ifdef STRONGDEBUG  // slow, but finds bugs!
+#ifdef _DEBUG
+	for(int x = rc.getLeft(); x < rc.getRight() - m_options.grid; x++)
 	{
-		ret = item;
+		for(int y = rc.getTop(); y < rc.getBottom() - m_options.grid; y++)
+		{
+			ASSERT(FindItemByPoint(m_layout[0].item, CPoint(x, y)) != NULL);
+		}
 	}
-
-	return ret;
+#endif
+#endif
 }
 
-void CTreeMap::DrawColorPreview(CSdlDisplay* display, const CRect& rc, uint32_t color, const Options *options)
+void CTreeMap::SetThreadPool(CThreadPool *pool)
 {
-	if (options != NULL)
-	{
-		SetOptions(options);
-	}
-
-	double surface[4];
-	for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
-	{
-		surface[i] = 0;
-	}
-
-	AddRidge(rc, surface, m_options.height * m_options.scaleFactor);
-
-	m_renderArea = rc;
-
-	// Recursively draw the tree graph
-	RenderRectangle(display, CRect(0, 0, rc.getWidth(), rc.getHeight()), surface, color);
-
-	if (m_options.grid)
-	{
-		display->fillSolidRect(rc, m_options.gridColor);
-	}
+	m_threadPool = pool;
 }
 
-void CTreeMap::RecurseDrawGraph(CSdlDisplay* display, Item *item, const CRect& rc, bool asroot, const double *psurface, double h, uint32_t flags)
+void CTreeMap::Cancel()
 {
-	ASSERT(rc.getWidth() >= 0);
-	ASSERT(rc.getHeight() >= 0);
+	m_cancelled = true;
+}
 
-	ASSERT(item->TmiGetRecursiveSize() > 0);
+bool CTreeMap::WasCancelled() const
+{
+	return m_cancelled;
+}
 
-	if (m_callback != NULL)
+const CTreeMap::LayoutRect *CTreeMap::FindLayoutRect(const Item *item) const
+{
+	if (m_layout.empty())
 	{
-		m_callback->TreemapDrawingCallback();
+		return NULL;
 	}
 
-	item->TmiSetRectangle(rc);
-
-	int gridWidth = m_options.grid ? 1 : 0;
-
-	if (rc.getWidth() <= gridWidth || rc.getHeight() <= gridWidth)
+	uint32_t slot = HashItem(item) & m_layoutIndexMask;
+	while (m_layoutIndex[slot] != 0)
 	{
-		return;
-	}
-
-	double surface[4];
-
-	if (IsCushionShading())
-	{
-		for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
-		{
-			surface[i] = psurface[i];
-		}
-
-		if (!asroot)
+		const LayoutRect& entry = m_layout[m_layoutIndex[slot] - 1];
+		if (entry.item == item)
 		{
-			AddRidge(rc, surface, h);
+			return &entry;
 		}
+		slot = (slot + 1) & m_layoutIndexMask;
 	}
+	return NULL;
+}
 
-	if (item->TmiIsLeaf())
+void CTreeMap::IndexLayout()
+{
+	// Every item has at most one entry. A load factor of at most a half
+	// keeps the probes short.
+	uint32_t tableSize = 1024;
+	while (tableSize < 2 * m_layout.size())
 	{
-		RenderLeaf(display, item, surface);
+		tableSize *= 2;
 	}
-	else
-	{
-		ASSERT(item->TmiGetChildrenCount() > 0);
-		ASSERT(item->TmiGetRecursiveSize() > 0);
+	m_layoutIndex.assign(tableSize, 0);
+	m_layoutIndexMask = tableSize - 1;
 
-		if(item->TmiGetLocalSize())
+	for (uint32_t i = 0; i < m_layout.size(); i++)
+	{
+		uint32_t slot = HashItem(m_layout[i].item) & m_layoutIndexMask;
+		while (m_layoutIndex[slot] != 0)
 		{
-			RenderLeaf(display, item, surface);
+			slot = (slot + 1) & m_layoutIndexMask;
 		}
-
-		DrawChildren(display, item, surface, h, flags);
+		m_layoutIndex[slot] = i + 1;
 	}
 }
 
-// My first approach was to make this member pure virtual and have three
-// classes derived from CTreemap. The disadvantage is then, that we cannot
-// simply have a member variable of type CTreemap but have to deal with
-// pointers, factory methods and explicit destruction. It's not worth.
+uint32_t CTreeMap::HashItem(const Item *item)
+{
+	// Fibonacci hashing, the low bits of a pointer are mostly alignment
+	const uint64_t key = reinterpret_cast<uintptr_t>(item);
+	return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
 
-void CTreeMap::DrawChildren(CSdlDisplay* display, Item *parent, const double *surface, double h, uint32_t flags)
+const std::vector<CTreeMap::LayoutRect>& CTreeMap::GetLayout() const
 {
-	switch (m_options.style)
-	{
-	case KDirStatStyle:
-	{
-		KDirStat_DrawChildren(display, parent, surface, h, flags);
-	}
-		break;
+	return m_layout;
+}
 
-	case SequoiaViewStyle:
+CTreeMap::Item *CTreeMap::GetItemAt(CPoint point) const
+{
+	// ptInRect() takes in the right and bottom edges too
+	if (m_pickBuffer.empty() || point.x < m_layoutArea.getLeft() || point.x >= m_layoutArea.getRight() || point.y < m_layoutArea.getTop() || point.y >= m_layoutArea.getBottom())
 	{
-		SequoiaView_DrawChildren(display, parent, surface, h, flags);
-	}
-		break;
+		return NULL;
 	}
+
+	const uint32_t pick = m_pickBuffer[(point.y - m_layoutArea.getTop()) * m_layoutArea.getWidth() + point.x - m_layoutArea.getLeft()];
+	return pick == 0 ? NULL : m_layout[pick - 1].item;
 }
 
-// I learned this squarification style from the KDirStat executable.
-// It's the most complex one here but also the clearest, imho.
-//
-void CTreeMap::KDirStat_DrawChildren(CSdlDisplay* display, Item *parent, const double *surface, double h, uint32_t /*flags*/)
+CTreeMap::Item *CTreeMap::FindItemByPoint(Item *item, CPoint point)
 {
-	ASSERT(parent->TmiGetChildrenCount() > 0);
-
-	const CRect& rc = parent->TmiGetRectangle();
-
-	std::vector<double> rows;    // Our rectangle is divided into rows, each of which gets this height (fraction of total height).
-	std::vector<int> childrenPerRow;    // childrenPerRow[i] = # of children in rows[i]
-
-	std::vector<double> childWidth; // Widths of the children (fraction of row width).
-	childWidth.resize(parent->TmiGetChildrenCount());
-
-	bool horizontalRows = KDirStat_ArrangeChildren(parent, childWidth, rows, childrenPerRow);
-
-	const int width = horizontalRows ? rc.getWidth() : rc.getHeight();
-	const int height = horizontalRows ? rc.getHeight() : rc.getWidth();
-	ASSERT(width >= 0);
-	ASSERT(height >= 0);
+	ASSERT(item != NULL);
+	const LayoutRect *entry = FindLayoutRect(item);
 
-	int c = 0;
-	double top = horizontalRows ? rc.getTop() : rc.getLeft();
-	for (int row = 0; row < rows.size(); row++)
+	if (entry == NULL || !entry->rc.ptInRect(point))
 	{
-		double fBottom = top + rows[row] * height;
-		int bottom = (int) fBottom;
-		if (row == rows.size() - 1)
-		{
-			bottom = horizontalRows ? rc.getBottom() : rc.getRight();
-		}
-		double left = horizontalRows ? rc.getLeft() : rc.getTop();
-		for (int i = 0; i < childrenPerRow[row]; i++, c++)
-		{
-			Item *child = parent->TmiGetChild(c);
-			ASSERT(childWidth[c] >= 0);
-			double fRight = left + childWidth[c] * width;
-			int right = (int) fRight;
-
-			bool lastChild = (i == childrenPerRow[row] - 1 || childWidth[c + 1] == 0);
-
-			if (lastChild)
-			{
-				right = horizontalRows ? rc.getRight() : rc.getBottom();
-			}
-
-			CRect rcChild;
-			if (horizontalRows)
-			{
-				rcChild.getLeft() = (int) left;
-				rcChild.getRight() = right;
-				rcChild.getTop() = (int) top;
-				rcChild.getBottom() = bottom;
-			}
-			else
-			{
-				rcChild.getLeft() = (int) top;
-				rcChild.getRight() = bottom;
-				rcChild.getTop() = (int) left;
-				rcChild.getBottom() = right;
-			}
-
-#ifdef _DEBUG
-			if(rcChild.getWidth() > 0 && rcChild.getHeight()() > 0)
-			{
-				CRect test;
-				test.IntersectRect(parent->TmiGetRectangle(), rcChild);
-				ASSERT(test == rcChild);
-			}
-#endif
-
-			RecurseDrawGraph(display, child, rcChild, false, surface, h * m_options.scaleFactor, 0);
-
-			if (lastChild)
-			{
-				i++, c++;
-
-				if (i < childrenPerRow[row])
-				{
-					parent->TmiGetChild(c)->TmiSetRectangle(CRect(-1, -1, -1, -1));
-				}
-
-				c += childrenPerRow[row] - i;
-				break;
-			}
-
-			left = fRight;
-		}
-		// This asserts due to rounding error: ASSERT(left == (horizontalRows ? rc.getRight() : rc.getBottom()));
-		top = fBottom;
+		// The only case that this function returns NULL is that
+		// point is not inside the rectangle of item.
+		//
+		// Take notice of
+		// (a) the very right an bottom lines, which can be "grid" and
+		//     are not covered by the root rectangle,
+		// (b) the fact, that WM_MOUSEMOVEs can occur after WM_SIZE but
+		//     before WM_PAINT.
+		//
+		return NULL;
 	}
-	// This asserts due to rounding error: ASSERT(top == (horizontalRows ? rc.getBottom() : rc.getRight()));
-}
 
-// return: whether the rows are horizontal.
-//
-bool CTreeMap::KDirStat_ArrangeChildren(Item *parent, std::vector<double>& childWidth, std::vector<double>& rows, std::vector<int>& childrenPerRow)
-{
-	ASSERT(!parent->TmiIsLeaf());
-	ASSERT(parent->TmiGetChildrenCount() > 0);
+	int gridWidth = m_options.grid ? 1 : 0;
 
-	if (parent->TmiGetRecursiveSize() == 0)
+	// The children of an entry follow it up to its end, each one
+	// followed by its own subtree. Children without room have no entry.
+	uint32_t index = entry - m_layout.data();
+	while (true)
 	{
-		rows.push_back(1.0);
-		childrenPerRow.push_back(parent->TmiGetChildrenCount());
-		for (int i = 0; i < parent->TmiGetChildrenCount(); i++)
+		const LayoutRect& parent = m_layout[index];
+		if (parent.rc.getWidth() <= gridWidth || parent.rc.getHeight() <= gridWidth)
 		{
-			childWidth[i] = 1.0 / parent->TmiGetChildrenCount();
+			return parent.item;
 		}
-		return true;
-	}
 
-	bool horizontalRows = (parent->TmiGetRectangle().getWidth() >= parent->TmiGetRectangle().getHeight());
-
-	double width = 1.0;
-	if (horizontalRows)
-	{
-		if (parent->TmiGetRectangle().getHeight() > 0)
+		uint32_t child = index + 1;
+		while (child < parent.end && !m_layout[child].rc.ptInRect(point))
 		{
-			width = (double) parent->TmiGetRectangle().getWidth() / parent->TmiGetRectangle().getHeight();
+			child = m_layout[child].end;
 		}
-	}
-	else
-	{
-		if (parent->TmiGetRectangle().getWidth() > 0)
+		if (child >= parent.end)
 		{
-			width = (double) parent->TmiGetRectangle().getHeight() / parent->TmiGetRectangle().getWidth();
+			// A leaf, or the point is on the item's own area
+			return parent.item;
 		}
-	}
 
-	int nextChild = 0;
-	while (nextChild < parent->TmiGetChildrenCount())
-	{
-		int childrenUsed;
-		rows.push_back(KDirStat_CalcutateNextRow(parent, nextChild, width, childrenUsed, childWidth));
-		childrenPerRow.push_back(childrenUsed);
-		nextChild += childrenUsed;
+#ifdef _DEBUG
+		const CRect& rcChild = m_layout[child].rc;
+		ASSERT(rcChild.getLeft() >= parent.rc.getLeft());
+		ASSERT(rcChild.getRight() <= parent.rc.getRight());
+		ASSERT(rcChild.getTop() >= parent.rc.getTop());
+		ASSERT(rcChild.getBottom() <= parent.rc.getBottom());
+#endif
+		index = child;
 	}
-
-	return horizontalRows;
 }
 
-double CTreeMap::KDirStat_CalcutateNextRow(Item *parent, const int nextChild, double width, int& childrenUsed, std::vector<double>& childWidth)
+void CTreeMap::DrawColorPreview(CFrameBuffer* display, const CRect& rc, uint32_t color, const Options *options)
 {
-	int i = 0;
-	static const double _minProportion = 0.4;
-	ASSERT(_minProportion < 1);
-
-	ASSERT(nextChild < parent->TmiGetChildrenCount());
-	ASSERT(width >= 1.0);
-
-	const double mySize = (double) parent->TmiGetRecursiveSize();
-	ASSERT(mySize > 0);
-	uint64_t sizeUsed = 0;
-	double rowHeight = 0;
-
-	for (i = nextChild; i < parent->TmiGetChildrenCount(); i++)
+	if (options != NULL)
 	{
-		uint64_t childSize = parent->TmiGetChild(i)->TmiGetRecursiveSize();
-		if (childSize == 0)
-		{
-			ASSERT(i > nextChild);  // first child has size > 0
-			break;
-		}
-
-		sizeUsed += childSize;
-		double virtualRowHeight = sizeUsed / mySize;
-		ASSERT(virtualRowHeight > 0);
-		ASSERT(virtualRowHeight <= 1);
-
-		// Rectangle(mySize)    = width * 1.0
-		// Rectangle(childSize) = childWidth * virtualRowHeight
-		// Rectangle(childSize) = childSize / mySize * width
-
-		double childWidth_ = childSize / mySize * width / virtualRowHeight;
-
-		if (childWidth_ / virtualRowHeight < _minProportion)
-		{
-			ASSERT(i > nextChild); // because width >= 1 and _minProportion < 1.
-			// For the first child we have:
-			// childWidth / rowHeight
-			// = childSize / mySize * width / rowHeight / rowHeight
-			// = childSize * width / sizeUsed / sizeUsed * mySize
-			// > childSize * mySize / sizeUsed / sizeUsed
-			// > childSize * childSize / childSize / childSize
-			// = 1 > _minProportion.
-			break;
-		}
-		rowHeight = virtualRowHeight;
+		SetOptions(options);
 	}
-	ASSERT(i > nextChild);
 
-	// Now i-1 is the last child used
-	// and rowHeight is the height of the row.
-
-	// We add the rest of the children, if their size is 0.
-	while (i < parent->TmiGetChildrenCount() && parent->TmiGetChild(i)->TmiGetRecursiveSize() == 0)
+	double surface[4];
+	for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
 	{
-		i++;
+		surface[i] = 0;
 	}
 
-	childrenUsed = i - nextChild;
+	AddRidge(rc, surface, m_options.height * m_options.scaleFactor);
+
+	m_renderArea = rc;
 
-	// Now as we know the rowHeight, we compute the widths of our children.
-	for (i = 0; i < childrenUsed; i++)
+	// Recursively draw the tree graph
+	const CRect rcPreview(0, 0, rc.getWidth(), rc.getHeight());
+	RenderRectangle(display, rcPreview, rcPreview, surface, color);
+
+	if (m_options.grid)
 	{
-		// Rectangle(1.0 * 1.0) = mySize
-		double rowSize = mySize * rowHeight;
-		double childSize = (double) parent->TmiGetChild(nextChild + i)->TmiGetRecursiveSize();
-		double cw = childSize / rowSize;
-		ASSERT(cw >= 0);
-		childWidth[nextChild + i] = cw;
+		display->fillSolidRect(rc, m_options.gridColor);
 	}
-
-	return rowHeight;
 }
 
-// The classical squarification method.
-//
-void CTreeMap::SequoiaView_DrawChildren(CSdlDisplay* display, Item *parent, const double *surface, double h, uint32_t /*flags*/)
-{
-	// Rest rectangle to fill
-	CRect remaining(parent->TmiGetRectangle());
-
-	ASSERT(remaining.getWidth() > 0);
-	ASSERT(remaining.getHeight() > 0);
-
-	// Size of rest rectangle
-	uint64_t remainingSize = parent->TmiGetRecursiveSize();
-	ASSERT(remainingSize > 0);
 
-	// Scale factor
-	const double sizePerSquarePixel = (double) parent->TmiGetRecursiveSize() / remaining.getWidth() / remaining.getHeight();
+bool CTreeMap::IsCushionShading()
+{
+	return m_options.ambientLight < 1.0 && m_options.height > 0.0 && m_options.scaleFactor > 0.0;
+}
 
-	// First child for next row
-	int head = 0;
+void CTreeMap::RenderEntry(CFrameBuffer* display, uint32_t index, bool thin, const CRect& clip)
+{
+	const LayoutRect& entry = m_layout[index];
 
-	// At least one child left
-	while (head < parent->TmiGetChildrenCount())
+	// The whole rectangle, grid lines included, like FindItemByPoint()
+	const int left = std::max(entry.rc.getLeft(), clip.getLeft());
+	const int top = std::max(entry.rc.getTop(), clip.getTop());
+	const int right = std::min(entry.rc.getRight(), clip.getRight());
+	const int bottom = std::min(entry.rc.getBottom(), clip.getBottom());
+	for (int y = top; y < bottom; y++)
 	{
-		ASSERT(remaining.getWidth() > 0);
-		ASSERT(remaining.getHeight() > 0);
-
-		// How we divide the remaining rectangle
-		bool horizontal = (remaining.getWidth() >= remaining.getHeight());
-
-		// Height of the new row
-		const int height = horizontal ? remaining.getHeight() : remaining.getWidth();
-
-		// Square of height in size scale for ratio formula
-		const double hh = (height * height) * sizePerSquarePixel;
-		ASSERT(hh > 0);
-
-		// Row will be made up of child(rowBegin)...child(rowEnd - 1)
-		int rowBegin = head;
-		int rowEnd = head;
-
-		// Worst ratio so far
-		double worst = std::numeric_limits<double>::max();
-
-		// Maximum size of children in row
-		uint64_t rmax = parent->TmiGetChild(rowBegin)->TmiGetRecursiveSize();
-
-		// Sum of sizes of children in row
-		uint64_t sum = 0;
-
-		// This condition will hold at least once.
-		while (rowEnd < parent->TmiGetChildrenCount())
-		{
-			// We check a virtual row made up of child(rowBegin)...child(rowEnd) here.
-
-			// Minimum size of child in virtual row
-			uint64_t rmin = parent->TmiGetChild(rowEnd)->TmiGetRecursiveSize();
-
-			// If sizes of the rest of the children is zero, we add all of them
-			if (rmin == 0)
-			{
-				rowEnd = parent->TmiGetChildrenCount();
-				break;
-			}
-
-			// Calculate the worst ratio in virtual row.
-			// Formula taken from the "Squarified Treemaps" paper.
-			// (http://http://www.win.tue.nl/~vanwijk/)
-
-			const double ss = ((double) sum + rmin) * ((double) sum + rmin);
-			const double ratio1 = hh * rmax / ss;
-			const double ratio2 = ss / hh / rmin;
-
-			const double nextWorst = std::max(ratio1, ratio2);
-
-			// Will the ratio get worse?
-			if (nextWorst > worst)
-			{
-				// Yes. Don't take the virtual row, but the
-				// real row (child(rowBegin)..child(rowEnd - 1))
-				// made so far.
-				break;
-			}
-
-			// Here we have decided to add child(rowEnd) to the row.
-			sum += rmin;
-			rowEnd++;
-
-			worst = nextWorst;
-		}
-
-		// Row will be made up of child(rowBegin)...child(rowEnd - 1).
-		// sum is the size of the row.
-
-		// As the size of parent is greater than zero, the size of
-		// the first child must have been greater than zero, too.
-		ASSERT(sum > 0);
-
-		// Width of row
-		int width = (horizontal ? remaining.getWidth() : remaining.getHeight());
-		ASSERT(width > 0);
-
-		if (sum < remainingSize)
-			width = (int) ((double) sum / remainingSize * width);
-		// else: use up the whole width
-		// width may be 0 here.
-
-		// Build the rectangles of children.
-		CRect rc;
-		double fBegin;
-		if (horizontal)
-		{
-			rc.getLeft() = remaining.getLeft();
-			rc.getRight() = remaining.getLeft() + width;
-			fBegin = remaining.getTop();
-		}
-		else
-		{
-			rc.getTop() = remaining.getTop();
-			rc.getBottom() = remaining.getTop() + width;
-			fBegin = remaining.getLeft();
-		}
-
-		// Now put the children into their places
-		for (int i = rowBegin; i < rowEnd; i++)
-		{
-			int begin = (int) fBegin;
-			double fraction = (double) (parent->TmiGetChild(i)->TmiGetRecursiveSize()) / sum;
-			double fEnd = fBegin + fraction * height;
-			int end = (int) fEnd;
-
-			bool lastChild = (i == rowEnd - 1 || parent->TmiGetChild(i + 1)->TmiGetRecursiveSize() == 0);
-
-			if (lastChild)
-			{
-				// Use up the whole height
-				end = (horizontal ? remaining.getTop() + height : remaining.getLeft() + height);
-			}
-
-			if (horizontal)
-			{
-				rc.getTop() = begin;
-				rc.getBottom() = end;
-			}
-			else
-			{
-				rc.getLeft() = begin;
-				rc.getRight() = end;
-			}
-
-			ASSERT(rc.getLeft() <= rc.getRight());
-			ASSERT(rc.getTop() <= rc.getBottom());
-
-			ASSERT(rc.getLeft() >= remaining.getLeft());
-			ASSERT(rc.getRight() <= remaining.getRight());
-			ASSERT(rc.getTop() >= remaining.getTop());
-			ASSERT(rc.getBottom() <= remaining.getBottom());
-
-			RecurseDrawGraph(display, parent->TmiGetChild(i), rc, false, surface, h * m_options.scaleFactor, 0);
-
-			if (lastChild)
-				break;
-
-			fBegin = fEnd;
-		}
-
-		// Put the next row into the rest of the rectangle
-		if (horizontal)
-		{
-			remaining.getLeft() += width;
-		}
-		else
-		{
-			remaining.getTop() += width;
-		}
-
-		remainingSize -= sum;
-
-		ASSERT(remaining.getLeft() <= remaining.getRight());
-		ASSERT(remaining.getTop() <= remaining.getBottom());
-
-		ASSERT(remainingSize >= 0);
-
-		head += (rowEnd - rowBegin);
-
-		if (remaining.getWidth() <= 0 || remaining.getHeight() <= 0)
-		{
-			if (head < parent->TmiGetChildrenCount())
-			{
-				parent->TmiGetChild(head)->TmiSetRectangle(CRect(-1, -1, -1, -1));
-			}
-
-			break;
-		}
+		uint32_t *row = m_pickBuffer.data() + (y - m_layoutArea.getTop()) * m_layoutArea.getWidth();
+		std::fill(row + left - m_layoutArea.getLeft(), row + right - m_layoutArea.getLeft(), index + 1);
 	}
-	//ASSERT(remainingSize == 0);
-	//ASSERT(remaining.getLeft() == remaining.getRight() || remaining.getTop() == remaining.getBottom());
-}
 
-bool CTreeMap::IsCushionShading()
-{
-	return m_options.ambientLight < 1.0 && m_options.height > 0.0 && m_options.scaleFactor > 0.0;
+	if (!thin)
+	{
+		RenderLeaf(display, entry, clip);
+	}
 }
 
-void CTreeMap::RenderLeaf(CSdlDisplay* display, Item *item, const double *surface)
+void CTreeMap::RenderLeaf(CFrameBuffer* display, const LayoutRect& entry, const CRect& clip)
 {
-	CRect rc = item->TmiGetRectangle();
+	CRect rc = entry.rc;
 
 	if (m_options.grid)
 	{
@@ -875,10 +502,22 @@ void CTreeMap::RenderLeaf(CSdlDisplay* display, Item *item, const double *surfac
 		}
 	}
 
-	RenderRectangle(display, rc, surface, item->TmiGetGraphColor());
+	// Every pixel only depends on its own position in rc and the
+	// surface, so clipping doesn't change what is drawn.
+	CRect rcClip = rc;
+	rcClip.getLeft() = std::max(rc.getLeft(), clip.getLeft());
+	rcClip.getTop() = std::max(rc.getTop(), clip.getTop());
+	rcClip.getRight() = std::min(rc.getRight(), clip.getRight());
+	rcClip.getBottom() = std::min(rc.getBottom(), clip.getBottom());
+	if (rcClip.getLeft() >= rcClip.getRight() || rcClip.getTop() >= rcClip.getBottom())
+	{
+		return;
+	}
+
+	RenderRectangle(display, rc, rcClip, entry.surface, entry.color);
 }
 
-void CTreeMap::RenderRectangle(CSdlDisplay* display, const CRect& rc, const double *surface, uint32_t color)
+void CTreeMap::RenderRectangle(CFrameBuffer* display, const CRect& rc, const CRect& clip, const double *surface, uint32_t color)
 {
 	double brightness = m_options.brightness;
 
@@ -903,15 +542,15 @@ void CTreeMap::RenderRectangle(CSdlDisplay* display, const CRect& rc, const doub
 
 	if (IsCushionShading())
 	{
-		DrawCushion(display, rc, surface, color, brightness);
+		DrawCushion(display, rc, clip, surface, color, brightness);
 	}
 	else
 	{
-		DrawSolidRect(display, rc, color, brightness);
+		DrawSolidRect(display, clip, color, brightness);
 	}
 }
 
-void CTreeMap::DrawSolidRect(CSdlDisplay* display, const CRect& rc, uint32_t col, double brightness)
+void CTreeMap::DrawSolidRect(CFrameBuffer* display, const CRect& rc, uint32_t col, double brightness)
 {
 	int red = RGB_GET_RVALUE(col);
 	int green = RGB_GET_GVALUE(col);
@@ -928,61 +567,21 @@ void CTreeMap::DrawSolidRect(CSdlDisplay* display, const CRect& rc, uint32_t col
 	display->fillSolidRect(rc, BGR(blue, green, red));
 }
 
-void CTreeMap::DrawCushion(CSdlDisplay* display, const CRect& rc, const double *surface, uint32_t col, double brightness)
+void CTreeMap::DrawCushion(CFrameBuffer* display, const CRect& rc, const CRect& clip, const double *surface, uint32_t col, double brightness)
 {
-	// Cushion parameters
-	const double Ia = m_options.ambientLight;
-
-	// Derived parameters
-	const double Is = 1 - Ia;   // shading
-
-	const double colR = RGB_GET_RVALUE(col);
-	const double colG = RGB_GET_GVALUE(col);
-	const double colB = RGB_GET_BVALUE(col);
-
-	uint32_t* screen = display->getScreen();
-
-	for (int iy = rc.getTop(); iy < rc.getBottom(); iy++)
-		for (int ix = rc.getLeft(); ix < rc.getRight(); ix++)
-		{
-			double nx = -(2 * surface[0] * (ix + 0.5) + surface[2]);
-			double ny = -(2 * surface[1] * (iy + 0.5) + surface[3]);
-			double cosa = (nx * m_Lx + ny * m_Ly + m_Lz) / sqrt(nx * nx + ny * ny + 1.0);
-			if (cosa > 1.0)
-			{
-				cosa = 1.0;
-			}
-
-			double pixel = Is * cosa;
-			if (pixel < 0)
-			{
-				pixel = 0;
-			}
-
-			pixel += Ia;
-			ASSERT(pixel <= 1.0);
-
-			// Now, pixel is the brightness of the pixel, 0...1.0.
-
-			// Apply contrast.
-			// Not implemented.
-			// Costs performance and nearly the same effect can be
-			// made width the m_options->ambientLight parameter.
-			// pixel = pow(pixel, m_options->contrast);
-
-			// Apply "brightness"
-			pixel *= brightness / PALETTE_BRIGHTNESS;
-
-			// Make color value
-			int red = (int) (colR * pixel);
-			int green = (int) (colG * pixel);
-			int blue = (int) (colB * pixel);
-
-			CColorSpace::NormalizeColor(red, green, blue);
+	CCushionShader::SParameters parameters;
+	for (int i = 0; i < 4; i++)
+	{
+		parameters.surface[i] = surface[i];
+	}
+	parameters.lx = m_Lx;
+	parameters.ly = m_Ly;
+	parameters.lz = m_Lz;
+	parameters.ambientLight = m_options.ambientLight;
+	parameters.brightness = brightness / PALETTE_BRIGHTNESS;
+	parameters.colour = col;
 
-			// ... and set!
-			screen[ix + iy * display->getWidth()] = BGR(blue, green, red);
-		}
+	CCushionShader::shadeRect(parameters, rc.getLeft(), rc.getTop(), rc.getRight(), rc.getBottom(), clip.getLeft(), clip.getTop(), clip.getRight(), clip.getBottom(), display->getScreen(), display->getPitch());
 }
 
 void CTreeMap::AddRidge(const CRect& rc, double *surface, double h)
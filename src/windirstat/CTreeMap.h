@@ -26,10 +26,12 @@
 #include <vector>
 #include <math.h>
 
-#include "../CSdlDisplay.h"
+#include "../CFrameBuffer.h"
 #include "../windirstat/CPoint.h"
 #include "../windirstat/CRect.h"
 
+class CThreadPool;
+
 //
 // CTreemap. Can create a treemap. Knows 3 squarification methods:
 // KDirStat-like, SequoiaView-like and Simple.
@@ -57,8 +59,6 @@ public:
 	{
 	public:
 		virtual bool TmiIsLeaf() const = 0;
-		virtual CRect TmiGetRectangle() const = 0;
-		virtual void TmiSetRectangle(const CRect& rc) = 0;
 		virtual uint32_t TmiGetGraphColor() const = 0;
 		virtual int TmiGetChildrenCount() const = 0;
 		virtual Item *TmiGetChild(int c) const = 0;
@@ -66,6 +66,26 @@ public:
 		virtual uint64_t TmiGetRecursiveSize() const = 0;
 	};
 
+	//
+	// ItemView. How the layout sees a tree: any class with a Node
+	// type and these members will do, see Layout(). This one goes
+	// through the Item interface, a view that knows the type of its
+	// nodes saves the virtual calls. Render() only reads the layout,
+	// so it makes no calls at all.
+	//
+	struct ItemView
+	{
+		typedef Item *Node;
+
+		bool IsLeaf(Node item) const                { return item->TmiIsLeaf(); }
+		int GetChildrenCount(Node item) const       { return item->TmiGetChildrenCount(); }
+		Node GetChild(Node item, int c) const       { return item->TmiGetChild(c); }
+		uint64_t GetLocalSize(Node item) const      { return item->TmiGetLocalSize(); }
+		uint64_t GetRecursiveSize(Node item) const  { return item->TmiGetRecursiveSize(); }
+		uint32_t GetGraphColor(Node item) const     { return item->TmiGetGraphColor(); }
+		Item *GetItem(Node item) const              { return item; }
+	};
+
 	//
 	// Callback. Interface with 1 "callback" method. Can be given
 	// to the CTreemap-constructor. The CTreemap will call the
@@ -74,7 +94,8 @@ public:
 	// building the treemap can last long (> 30 seconds).
 	// TreemapDrawingCallback() gives the chance to provide at
 	// least a little visual feedback (Update of RAM usage
-	// indicator, for instance).
+	// indicator, for instance), or to Cancel() when the
+	// treemap isn't wanted any more.
 	//
 	class Callback
 	{
@@ -82,6 +103,21 @@ public:
 		virtual void TreemapDrawingCallback() = 0;
 	};
 
+	//
+	// LayoutRect. One entry per laid out item, in drawing order
+	// (parents before their children). Built by Layout() and
+	// painted by Render().
+	//
+	struct LayoutRect
+	{
+		Item *item;
+		CRect rc;               // Where the item was laid out
+		double surface[4];      // Cushion coefficients, see AddRidge()
+		uint32_t color;         // As returned by TmiGetGraphColor()
+		uint32_t end;           // Index after the last entry of the item's subtree
+		bool paint;             // Leaf, aggregate, or has a local size of its own
+	};
+
 	//
 	// Treemap squarification style.
 	//
@@ -105,6 +141,7 @@ public:
 		double ambientLight;    // 0..1.0   (default = 0.15)    Factor "Ia"
 		double lightSourceX;    // -4.0..+4.0 (default = -1.0), negative = left
 		double lightSourceY;    // -4.0..+4.0 (default = -1.0), negative = top
+		uint32_t lodArea;       // Subtrees of fewer pixels are one block, 0 = off
 
 		int GetBrightnessPercent()
 		{
@@ -192,35 +229,83 @@ public:
 	void SetOptions(const Options *options);
 	Options GetOptions();
 
-#ifdef _DEBUG
-	// DEBUG function
-	void RecurseCheckTree(Item *item);
-#endif // _DEBUG
+	// Create and draw a treemap, same as Layout() followed by Render()
+	void DrawTreemap(CFrameBuffer* display, CRect rc, Item *root, const Options *options = NULL);
+	template <typename VIEW>
+	void DrawTreemap(CFrameBuffer* display, CRect rc, const VIEW& view, typename VIEW::Node root, const Options *options = NULL);
 
-	// Create and draw a treemap
-	void DrawTreemap(CSdlDisplay* display, CRect rc, Item *root, const Options *options = NULL);
+	// Squarify the tree and compute the cushions without drawing
+	// anything. The result is kept, so Render() can repaint it with
+	// other grid, color, brightness or lighting options. Changing
+	// style, height, scaleFactor or lodArea needs a new Layout().
+	void Layout(CRect rc, Item *root, const Options *options = NULL);
+	// The same with the sizes and children as view sees them
+	template <typename VIEW>
+	void Layout(CRect rc, const VIEW& view, typename VIEW::Node root, const Options *options = NULL);
+
+	// Paint the result of the last Layout()
+	void Render(CFrameBuffer* display, const Options *options = NULL);
+
+	// With a pool of more than one thread Render() bins the rectangles
+	// into tiles of TILE_SIZE pixels and paints the tiles in parallel.
+	// The result is the same as painting them one after the other.
+	void SetThreadPool(CThreadPool *pool);
+	static const uint32_t TILE_SIZE = 64;
+
+	const std::vector<LayoutRect>& GetLayout() const;
+
+	// The entry of item in the last Layout(), NULL if it got no room.
+	// A hash lookup, see IndexLayout().
+	const LayoutRect *FindLayoutRect(const Item *item) const;
+
+	// To be called from the callback: abandons the Layout() or Render()
+	// in progress. A cancelled Layout() leaves nothing to Render().
+	void Cancel();
+	bool WasCancelled() const;
 
 	// In the resulting treemap, find the item below a given coordinate.
-	// Return value can be NULL, iff point is outside root rect.
+	// Return value can be NULL, iff point is outside root rect. Only
+	// the last Layout() is searched, the items don't keep their
+	// rectangles, so several treemaps can lay out one tree at once.
 	Item *FindItemByPoint(Item *root, CPoint point);
 
+	// Same as FindItemByPoint() on the last Render(), but a single
+	// lookup in the pick buffer it wrote. NULL before Render().
+	Item *GetItemAt(CPoint point) const;
+
 	// Draws a sample rectangle in the given style (for color legend)
-	void DrawColorPreview(CSdlDisplay* display, const CRect& rc, uint32_t color, const Options *options = NULL);
+	void DrawColorPreview(CFrameBuffer* display, const CRect& rc, uint32_t color, const Options *options = NULL);
 
 protected:
-	// The recursive drawing function
-	void RecurseDrawGraph(CSdlDisplay* display, Item *item, const CRect& rc, bool asroot, const double *psurface, double h, uint32_t flags);
+#ifdef _DEBUG
+	// DEBUG function
+	template <typename VIEW>
+	void RecurseCheckTree(const VIEW& view, typename VIEW::Node item);
+#endif // _DEBUG
+
+	// The recursive layout function
+	template <typename VIEW>
+	void RecurseLayout(const VIEW& view, typename VIEW::Node item, const CRect& rc, bool asroot, const double *psurface, double h, uint32_t flags);
 
-	// This function switches to KDirStat-, SequoiaView- or Simple_DrawChildren
-	void DrawChildren(CSdlDisplay* display, Item *parent, const double *surface, double h, uint32_t flags);
+	// This function switches to KDirStat-, SequoiaView- or Simple_LayoutChildren
+	template <typename VIEW>
+	void LayoutChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, const double *surface, double h, uint32_t flags);
 
 	// KDirStat-like squarification
-	void KDirStat_DrawChildren(CSdlDisplay* display, Item *parent, const double *surface, double h, uint32_t flags);
-	bool KDirStat_ArrangeChildren(Item *parent, std::vector<double>& childWidth, std::vector<double>& rows, std::vector<int>& childrenPerRow);
-	double KDirStat_CalcutateNextRow(Item *parent, const int nextChild, double width, int& childrenUsed, std::vector<double>& childWidth);
+	template <typename VIEW>
+	void KDirStat_LayoutChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, const double *surface, double h, uint32_t flags);
+	template <typename VIEW>
+	bool KDirStat_ArrangeChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, std::vector<double>& childWidth, std::vector<double>& rows, std::vector<int>& childrenPerRow);
+	template <typename VIEW>
+	double KDirStat_CalcutateNextRow(const VIEW& view, typename VIEW::Node parent, const int nextChild, double width, int& childrenUsed, std::vector<double>& childWidth);
 
 	// Classical SequoiaView-like squarification
-	void SequoiaView_DrawChildren(CSdlDisplay* display, Item *parent, const double *surface, double h, uint32_t flags);
+	template <typename VIEW>
+	void SequoiaView_LayoutChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, const double *surface, double h, uint32_t flags);
+
+	// Fills m_layoutIndex from m_layout, at the end of Layout()
+	void IndexLayout();
+	static uint32_t HashItem(const Item *item);
 
 	// Sets brightness to a good value, if system has only 256 colors
 	void SetBrightnessFor256();
@@ -228,18 +313,24 @@ protected:
 	// Returns true, if height and scaleFactor are > 0 and ambientLight is < 1.0
 	bool IsCushionShading();
 
-	// Leaves space for grid and then calls RenderRectangle()
-	void RenderLeaf(CSdlDisplay* display, Item *item, const double *surface);
+	// Writes the entry to the pick buffer and, unless it is too
+	// thin to show inside the grid, calls RenderLeaf()
+	void RenderEntry(CFrameBuffer* display, uint32_t index, bool thin, const CRect& clip);
+
+	// Leaves space for grid and then calls RenderRectangle() for
+	// the part inside clip
+	void RenderLeaf(CFrameBuffer* display, const LayoutRect& entry, const CRect& clip);
 
-	// Either calls DrawCushion() or DrawSolidRect()
-	void RenderRectangle(CSdlDisplay* display, const CRect& rc, const double *surface, uint32_t color);
-	// void RenderRectangle(CSdlDisplay* display, const CRect& rc, const double *surface, uint32_t color);
+	// Either calls DrawCushion() or DrawSolidRect() for the part of rc
+	// inside clip
+	void RenderRectangle(CFrameBuffer* display, const CRect& rc, const CRect& clip, const double *surface, uint32_t color);
+	// void RenderRectangle(CFrameBuffer* display, const CRect& rc, const double *surface, uint32_t color);
 
-	// Draws the surface using SetPixel()
-	void DrawCushion(CSdlDisplay* display, const CRect& rc, const double *surface, uint32_t col, double brightness);
+	// Draws the part of the surface inside clip with CCushionShader
+	void DrawCushion(CFrameBuffer* display, const CRect& rc, const CRect& clip, const double *surface, uint32_t col, double brightness);
 
 	// Draws the surface using FillSolidRect()
-	void DrawSolidRect(CSdlDisplay* display, const CRect& rc, uint32_t col, double brightness);
+	void DrawSolidRect(CFrameBuffer* display, const CRect& rc, uint32_t col, double brightness);
 
 	// Adds a new ridge to surface
 	static void AddRidge(const CRect& rc, double *surface, double h);
@@ -251,18 +342,28 @@ protected:
 
 	CRect m_renderArea;
 
+	CRect m_layoutArea;                 // Rectangle given to Layout()
+	bool m_layoutEmpty;                 // Root had nothing to show
+	std::vector<LayoutRect> m_layout;   // Result of Layout()
+	std::vector<uint32_t> m_pickBuffer; // Per pixel of m_layoutArea, index + 1 into m_layout or 0
+	std::vector<uint32_t> m_layoutIndex; // Open addressed by HashItem(), index + 1 into m_layout or 0
+	uint32_t m_layoutIndexMask;
+
 	Options m_options;      // Current options
 	double m_Lx;            // Derived parameters
 	double m_Ly;
 	double m_Lz;
 
 	Callback *m_callback;   // Current callback
+	bool m_cancelled;       // Cancel() was called
+	CThreadPool *m_threadPool;
 };
 
 template <typename T> int signum(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
+#include "CTreeMapLayout.h"
 
 
 #endif
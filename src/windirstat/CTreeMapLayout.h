@@ -0,0 +1,625 @@
+// CTreeMapLayout.h - Squarification of CTreemap, templated on the tree view
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2017 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __CTREEMAPLAYOUT_H__
+#define __CTREEMAPLAYOUT_H__
+
+// Included by CTreeMap.h. The layout is instantiated for each view, so
+// the queries of a view that knows its tree are inlined into the loops.
+
+#include <assert.h>
+#include <algorithm>
+#include <limits>
+
+#ifndef ASSERT
+#define ASSERT assert
+#endif
+
+template <typename VIEW>
+void CTreeMap::DrawTreemap(CFrameBuffer* display, CRect rc, const VIEW& view, typename VIEW::Node root, const Options *options)
+{
+	Layout(rc, view, root, options);
+	if (!m_cancelled)
+	{
+		Render(display);
+	}
+}
+
+#ifdef _DEBUG
+template <typename VIEW>
+void CTreeMap::RecurseCheckTree(const VIEW& view, typename VIEW::Node item)
+{
+	if(view.IsLeaf(item))
+	{
+		ASSERT(view.GetChildrenCount(item) == 0);
+	}
+	else
+	{
+// TODO: check that children are sorted by size.
+		uint64_t sum = 0;
+		for(int i = 0; i < view.GetChildrenCount(item); i++)
+		{
+			typename VIEW::Node child = view.GetChild(item, i);
+			sum += view.GetRecursiveSize(child);
+			RecurseCheckTree(view, child);
+		}
+		ASSERT(sum == view.GetRecursiveSize(item));
+	}
+}
+#endif
+
+template <typename VIEW>
+void CTreeMap::Layout(CRect rc, const VIEW& view, typename VIEW::Node root, const Options *options)
+{
+#ifdef _DEBUG
+	RecurseCheckTree(view, root);
+#endif // _DEBUG
+
+	if (options != NULL)
+	{
+		SetOptions(options);
+	}
+
+	m_layout.clear();
+	m_layoutArea = rc;
+	m_layoutEmpty = true;
+	m_pickBuffer.clear();
+	m_cancelled = false;
+
+	if (rc.getWidth() <= 0 || rc.getHeight() <= 0)
+	{
+		return;
+	}
+
+	// Render() leaves the right and bottom lines for the grid
+	// or border, so the layout doesn't change with the grid.
+	rc.getRight()--;
+	rc.getBottom()--;
+
+	if (rc.getWidth() <= 0 || rc.getHeight() <= 0)
+	{
+		return;
+	}
+
+	m_renderArea = rc;
+
+	if (view.GetRecursiveSize(root) > 0)
+	{
+		double surface[4];
+		for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
+		{
+			surface[i] = 0;
+		}
+
+		m_layoutEmpty = false;
+
+		// Recursively lay out the tree graph
+		RecurseLayout(view, root, rc, true, surface, m_options.height, 0);
+	}
+
+	if (m_cancelled)
+	{
+		// Half a layout, leave nothing for Render()
+		m_layout.clear();
+		m_layoutArea = CRect();
+	}
+	IndexLayout();
+}
+
+template <typename VIEW>
+void CTreeMap::RecurseLayout(const VIEW& view, typename VIEW::Node item, const CRect& rc, bool asroot, const double *psurface, double h, uint32_t flags)
+{
+	ASSERT(rc.getWidth() >= 0);
+	ASSERT(rc.getHeight() >= 0);
+
+	ASSERT(view.GetRecursiveSize(item) > 0);
+
+	if (m_callback != NULL)
+	{
+		m_callback->TreemapDrawingCallback();
+		if (m_cancelled)
+		{
+			return;
+		}
+	}
+
+	if (rc.getWidth() <= 0 || rc.getHeight() <= 0)
+	{
+		return;
+	}
+
+	// The children are appended behind us, which may move the entry
+	const uint32_t index = m_layout.size();
+	m_layout.push_back(LayoutRect());
+
+	double surface[4];
+	for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
+	{
+		surface[i] = psurface[i];
+	}
+
+	if (!asroot)
+	{
+		AddRidge(rc, surface, h);
+	}
+
+	LayoutRect& entry = m_layout[index];
+	entry.item = view.GetItem(item);
+	entry.rc = rc;
+	for (int i = 0; i < sizeof(surface)/sizeof(*surface); i++)
+	{
+		entry.surface[i] = surface[i];
+	}
+	// Level of detail: a subtree with less room than lodArea is
+	// drawn, and picked, as one block in the item's own color
+	const bool aggregate = !view.IsLeaf(item) && (uint64_t) rc.getWidth() * rc.getHeight() < m_options.lodArea;
+
+	entry.color = view.GetGraphColor(item);
+	entry.paint = view.IsLeaf(item) || aggregate || view.GetLocalSize(item) > 0;
+
+	if (!view.IsLeaf(item) && !aggregate)
+	{
+		ASSERT(view.GetChildrenCount(item) > 0);
+		ASSERT(view.GetRecursiveSize(item) > 0);
+
+		LayoutChildren(view, item, rc, surface, h, flags);
+	}
+
+	m_layout[index].end = m_layout.size();
+}
+
+// My first approach was to make this member pure virtual and have three
+// classes derived from CTreemap. The disadvantage is then, that we cannot
+// simply have a member variable of type CTreemap but have to deal with
+// pointers, factory methods and explicit destruction. It's not worth.
+
+template <typename VIEW>
+void CTreeMap::LayoutChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, const double *surface, double h, uint32_t flags)
+{
+	switch (m_options.style)
+	{
+	case KDirStatStyle:
+	{
+		KDirStat_LayoutChildren(view, parent, rc, surface, h, flags);
+	}
+		break;
+
+	case SequoiaViewStyle:
+	{
+		SequoiaView_LayoutChildren(view, parent, rc, surface, h, flags);
+	}
+		break;
+	}
+}
+
+// I learned this squarification style from the KDirStat executable.
+// It's the most complex one here but also the clearest, imho.
+//
+template <typename VIEW>
+void CTreeMap::KDirStat_LayoutChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, const double *surface, double h, uint32_t /*flags*/)
+{
+	ASSERT(view.GetChildrenCount(parent) > 0);
+
+	std::vector<double> rows;    // Our rectangle is divided into rows, each of which gets this height (fraction of total height).
+	std::vector<int> childrenPerRow;    // childrenPerRow[i] = # of children in rows[i]
+
+	std::vector<double> childWidth; // Widths of the children (fraction of row width).
+	childWidth.resize(view.GetChildrenCount(parent));
+
+	bool horizontalRows = KDirStat_ArrangeChildren(view, parent, rc, childWidth, rows, childrenPerRow);
+
+	const int width = horizontalRows ? rc.getWidth() : rc.getHeight();
+	const int height = horizontalRows ? rc.getHeight() : rc.getWidth();
+	ASSERT(width >= 0);
+	ASSERT(height >= 0);
+
+	int c = 0;
+	double top = horizontalRows ? rc.getTop() : rc.getLeft();
+	for (int row = 0; row < rows.size(); row++)
+	{
+		double fBottom = top + rows[row] * height;
+		int bottom = (int) fBottom;
+		if (row == rows.size() - 1)
+		{
+			bottom = horizontalRows ? rc.getBottom() : rc.getRight();
+		}
+		double left = horizontalRows ? rc.getLeft() : rc.getTop();
+		for (int i = 0; i < childrenPerRow[row]; i++, c++)
+		{
+			typename VIEW::Node child = view.GetChild(parent, c);
+			ASSERT(childWidth[c] >= 0);
+			double fRight = left + childWidth[c] * width;
+			int right = (int) fRight;
+
+			bool lastChild = (i == childrenPerRow[row] - 1 || childWidth[c + 1] == 0);
+
+			if (lastChild)
+			{
+				right = horizontalRows ? rc.getRight() : rc.getBottom();
+			}
+
+			CRect rcChild;
+			if (horizontalRows)
+			{
+				rcChild.getLeft() = (int) left;
+				rcChild.getRight() = right;
+				rcChild.getTop() = (int) top;
+				rcChild.getBottom() = bottom;
+			}
+			else
+			{
+				rcChild.getLeft() = (int) top;
+				rcChild.getRight() = bottom;
+				rcChild.getTop() = (int) left;
+				rcChild.getBottom() = right;
+			}
+
+#ifdef _DEBUG
+			if(rcChild.getWidth() > 0 && rcChild.getHeight() > 0)
+			{
+				CRect test;
+				test.IntersectRect(rc, rcChild);
+				ASSERT(test == rcChild);
+			}
+#endif
+
+			RecurseLayout(view, child, rcChild, false, surface, h * m_options.scaleFactor, 0);
+
+			if (lastChild)
+			{
+				i++, c++;
+				c += childrenPerRow[row] - i;
+				break;
+			}
+
+			left = fRight;
+		}
+		// This asserts due to rounding error: ASSERT(left == (horizontalRows ? rc.getRight() : rc.getBottom()));
+		top = fBottom;
+	}
+	// This asserts due to rounding error: ASSERT(top == (horizontalRows ? rc.getBottom() : rc.getRight()));
+}
+
+// return: whether the rows are horizontal.
+//
+template <typename VIEW>
+bool CTreeMap::KDirStat_ArrangeChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rc, std::vector<double>& childWidth, std::vector<double>& rows, std::vector<int>& childrenPerRow)
+{
+	ASSERT(!view.IsLeaf(parent));
+	ASSERT(view.GetChildrenCount(parent) > 0);
+
+	const int childCount = view.GetChildrenCount(parent);
+
+	if (view.GetRecursiveSize(parent) == 0)
+	{
+		rows.push_back(1.0);
+		childrenPerRow.push_back(childCount);
+		for (int i = 0; i < childCount; i++)
+		{
+			childWidth[i] = 1.0 / childCount;
+		}
+		return true;
+	}
+
+	bool horizontalRows = (rc.getWidth() >= rc.getHeight());
+
+	double width = 1.0;
+	if (horizontalRows)
+	{
+		if (rc.getHeight() > 0)
+		{
+			width = (double) rc.getWidth() / rc.getHeight();
+		}
+	}
+	else
+	{
+		if (rc.getWidth() > 0)
+		{
+			width = (double) rc.getHeight() / rc.getWidth();
+		}
+	}
+
+	int nextChild = 0;
+	while (nextChild < childCount)
+	{
+		int childrenUsed;
+		rows.push_back(KDirStat_CalcutateNextRow(view, parent, nextChild, width, childrenUsed, childWidth));
+		childrenPerRow.push_back(childrenUsed);
+		nextChild += childrenUsed;
+	}
+
+	return horizontalRows;
+}
+
+template <typename VIEW>
+double CTreeMap::KDirStat_CalcutateNextRow(const VIEW& view, typename VIEW::Node parent, const int nextChild, double width, int& childrenUsed, std::vector<double>& childWidth)
+{
+	int i = 0;
+	static const double _minProportion = 0.4;
+	ASSERT(_minProportion < 1);
+
+	const int childCount = view.GetChildrenCount(parent);
+
+	ASSERT(nextChild < childCount);
+	ASSERT(width >= 1.0);
+
+	const double mySize = (double) view.GetRecursiveSize(parent);
+	ASSERT(mySize > 0);
+	uint64_t sizeUsed = 0;
+	double rowHeight = 0;
+
+	for (i = nextChild; i < childCount; i++)
+	{
+		uint64_t childSize = view.GetRecursiveSize(view.GetChild(parent, i));
+		if (childSize == 0)
+		{
+			ASSERT(i > nextChild);  // first child has size > 0
+			break;
+		}
+
+		sizeUsed += childSize;
+		double virtualRowHeight = sizeUsed / mySize;
+		ASSERT(virtualRowHeight > 0);
+		ASSERT(virtualRowHeight <= 1);
+
+		// Rectangle(mySize)    = width * 1.0
+		// Rectangle(childSize) = childWidth * virtualRowHeight
+		// Rectangle(childSize) = childSize / mySize * width
+
+		double childWidth_ = childSize / mySize * width / virtualRowHeight;
+
+		if (childWidth_ / virtualRowHeight < _minProportion)
+		{
+			ASSERT(i > nextChild); // because width >= 1 and _minProportion < 1.
+			// For the first child we have:
+			// childWidth / rowHeight
+			// = childSize / mySize * width / rowHeight / rowHeight
+			// = childSize * width / sizeUsed / sizeUsed * mySize
+			// > childSize * mySize / sizeUsed / sizeUsed
+			// > childSize * childSize / childSize / childSize
+			// = 1 > _minProportion.
+			break;
+		}
+		rowHeight = virtualRowHeight;
+	}
+	ASSERT(i > nextChild);
+
+	// Now i-1 is the last child used
+	// and rowHeight is the height of the row.
+
+	// We add the rest of the children, if their size is 0.
+	while (i < childCount && view.GetRecursiveSize(view.GetChild(parent, i)) == 0)
+	{
+		i++;
+	}
+
+	childrenUsed = i - nextChild;
+
+	// Now as we know the rowHeight, we compute the widths of our children.
+	for (i = 0; i < childrenUsed; i++)
+	{
+		// Rectangle(1.0 * 1.0) = mySize
+		double rowSize = mySize * rowHeight;
+		double childSize = (double) view.GetRecursiveSize(view.GetChild(parent, nextChild + i));
+		double cw = childSize / rowSize;
+		ASSERT(cw >= 0);
+		childWidth[nextChild + i] = cw;
+	}
+
+	return rowHeight;
+}
+
+// The classical squarification method.
+//
+template <typename VIEW>
+void CTreeMap::SequoiaView_LayoutChildren(const VIEW& view, typename VIEW::Node parent, const CRect& rcParent, const double *surface, double h, uint32_t /*flags*/)
+{
+	// Rest rectangle to fill
+	CRect remaining(rcParent);
+
+	ASSERT(remaining.getWidth() > 0);
+	ASSERT(remaining.getHeight() > 0);
+
+	// Size of rest rectangle
+	uint64_t remainingSize = view.GetRecursiveSize(parent);
+	ASSERT(remainingSize > 0);
+
+	// Scale factor
+	const double sizePerSquarePixel = (double) view.GetRecursiveSize(parent) / remaining.getWidth() / remaining.getHeight();
+
+	// First child for next row
+	int head = 0;
+	const int childCount = view.GetChildrenCount(parent);
+
+	// At least one child left
+	while (head < childCount)
+	{
+		ASSERT(remaining.getWidth() > 0);
+		ASSERT(remaining.getHeight() > 0);
+
+		// How we divide the remaining rectangle
+		bool horizontal = (remaining.getWidth() >= remaining.getHeight());
+
+		// Height of the new row
+		const int height = horizontal ? remaining.getHeight() : remaining.getWidth();
+
+		// Square of height in size scale for ratio formula
+		const double hh = (height * height) * sizePerSquarePixel;
+		ASSERT(hh > 0);
+
+		// Row will be made up of child(rowBegin)...child(rowEnd - 1)
+		int rowBegin = head;
+		int rowEnd = head;
+
+		// Worst ratio so far
+		double worst = std::numeric_limits<double>::max();
+
+		// Maximum size of children in row
+		uint64_t rmax = view.GetRecursiveSize(view.GetChild(parent, rowBegin));
+
+		// Sum of sizes of children in row
+		uint64_t sum = 0;
+
+		// This condition will hold at least once.
+		while (rowEnd < childCount)
+		{
+			// We check a virtual row made up of child(rowBegin)...child(rowEnd) here.
+
+			// Minimum size of child in virtual row
+			uint64_t rmin = view.GetRecursiveSize(view.GetChild(parent, rowEnd));
+
+			// If sizes of the rest of the children is zero, we add all of them
+			if (rmin == 0)
+			{
+				rowEnd = childCount;
+				break;
+			}
+
+			// Calculate the worst ratio in virtual row.
+			// Formula taken from the "Squarified Treemaps" paper.
+			// (http://http://www.win.tue.nl/~vanwijk/)
+
+			const double ss = ((double) sum + rmin) * ((double) sum + rmin);
+			const double ratio1 = hh * rmax / ss;
+			const double ratio2 = ss / hh / rmin;
+
+			const double nextWorst = std::max(ratio1, ratio2);
+
+			// Will the ratio get worse?
+			if (nextWorst > worst)
+			{
+				// Yes. Don't take the virtual row, but the
+				// real row (child(rowBegin)..child(rowEnd - 1))
+				// made so far.
+				break;
+			}
+
+			// Here we have decided to add child(rowEnd) to the row.
+			sum += rmin;
+			rowEnd++;
+
+			worst = nextWorst;
+		}
+
+		// Row will be made up of child(rowBegin)...child(rowEnd - 1).
+		// sum is the size of the row.
+
+		// As the size of parent is greater than zero, the size of
+		// the first child must have been greater than zero, too.
+		ASSERT(sum > 0);
+
+		// Width of row
+		int width = (horizontal ? remaining.getWidth() : remaining.getHeight());
+		ASSERT(width > 0);
+
+		if (sum < remainingSize)
+			width = (int) ((double) sum / remainingSize * width);
+		// else: use up the whole width
+		// width may be 0 here.
+
+		// Build the rectangles of children.
+		CRect rc;
+		double fBegin;
+		if (horizontal)
+		{
+			rc.getLeft() = remaining.getLeft();
+			rc.getRight() = remaining.getLeft() + width;
+			fBegin = remaining.getTop();
+		}
+		else
+		{
+			rc.getTop() = remaining.getTop();
+			rc.getBottom() = remaining.getTop() + width;
+			fBegin = remaining.getLeft();
+		}
+
+		// Now put the children into their places
+		for (int i = rowBegin; i < rowEnd; i++)
+		{
+			int begin = (int) fBegin;
+			double fraction = (double) (view.GetRecursiveSize(view.GetChild(parent, i))) / sum;
+			double fEnd = fBegin + fraction * height;
+			int end = (int) fEnd;
+
+			bool lastChild = (i == rowEnd - 1 || view.GetRecursiveSize(view.GetChild(parent, i + 1)) == 0);
+
+			if (lastChild)
+			{
+				// Use up the whole height
+				end = (horizontal ? remaining.getTop() + height : remaining.getLeft() + height);
+			}
+
+			if (horizontal)
+			{
+				rc.getTop() = begin;
+				rc.getBottom() = end;
+			}
+			else
+			{
+				rc.getLeft() = begin;
+				rc.getRight() = end;
+			}
+
+			ASSERT(rc.getLeft() <= rc.getRight());
+			ASSERT(rc.getTop() <= rc.getBottom());
+
+			ASSERT(rc.getLeft() >= remaining.getLeft());
+			ASSERT(rc.getRight() <= remaining.getRight());
+			ASSERT(rc.getTop() >= remaining.getTop());
+			ASSERT(rc.getBottom() <= remaining.getBottom());
+
+			RecurseLayout(view, view.GetChild(parent, i), rc, false, surface, h * m_options.scaleFactor, 0);
+
+			if (lastChild)
+				break;
+
+			fBegin = fEnd;
+		}
+
+		// Put the next row into the rest of the rectangle
+		if (horizontal)
+		{
+			remaining.getLeft() += width;
+		}
+		else
+		{
+			remaining.getTop() += width;
+		}
+
+		remainingSize -= sum;
+
+		ASSERT(remaining.getLeft() <= remaining.getRight());
+		ASSERT(remaining.getTop() <= remaining.getBottom());
+
+		ASSERT(remainingSize >= 0);
+
+		head += (rowEnd - rowBegin);
+
+		if (remaining.getWidth() <= 0 || remaining.getHeight() <= 0)
+		{
+			break;
+		}
+	}
+	//ASSERT(remainingSize == 0);
+	//ASSERT(remaining.getLeft() == remaining.getRight() || remaining.getTop() == remaining.getBottom());
+}
+
+#endif